@@ -3,19 +3,34 @@
 
 #include <alsa/asoundlib.h>
 #include <alsa/pcm_external.h>
+#include <sys/mman.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 
 AlsaPluginDxO::AlsaPluginDxO(const std::string& path,
                              uint32_t blockSize,
                              uint32_t firDelay,
                              const std::string slavePcm,
-                             const snd_pcm_ioplug_callback_t* callbacks)
+                             const snd_pcm_ioplug_callback_t* callbacks,
+                             FirMultiChannelCrossover::Partitioning partitioning,
+                             const std::string& spectrumCachePath,
+                             const std::string& fftWisdomPath,
+                             bool staticSchedule,
+                             uint32_t asyncDepth,
+                             snd_pcm_format_t outputFormat,
+                             const Routing& routing,
+                             bool batchedFft,
+                             bool zeroLatency)
     : blockSize_(blockSize),
       firDelay_(firDelay),
-      inputs_(3),
-      outputs_(7),
+      routing_(routing),
+      silence_(blockSize),
       inputOffset_(0),
-      outputBuffer_{new int16_t[blockSize_ * kNumOutputChannels]},
-      pcmName_(slavePcm)
+      pcmName_(slavePcm),
+      outputFormat_(outputFormat),
+      asyncDepth_(asyncDepth)
 {
   memset(this, 0, sizeof(snd_pcm_ioplug_t));
 
@@ -25,28 +40,101 @@ AlsaPluginDxO::AlsaPluginDxO(const std::string& path,
   snd_pcm_ioplug_t::private_data = this;
   snd_pcm_ioplug_t::callback = callbacks;
 
-  auto coeffs = loadFIRCoeffs(path, kScaleS16LE);
-  assert(coeffs.size() == 7 && "Coeffs file need to provide 7 FIR transfer functions");
+  // plans are restored from wisdom instead of measured again
+  FftWisdom wisdom{fftWisdomPath};
+
+  std::shared_ptr<SpectrumCache> cache;
+  if(spectrumCachePath.length() > 0)
+  {
+    // cached filters carry the gains of the routes
+    auto hash = SpectrumCache::hashFile(path) ^ routing_.hash();
+    // zero latency splits off the head => other spectra
+    auto variant = static_cast<uint32_t>(partitioning) | (zeroLatency ? 0x100 : 0);
+    // spectra are stored segment by segment => a new segmentation needs new spectra
+    SpectrumCache::LayoutHash layout = nullptr;
+    if(partitioning == FirMultiChannelCrossover::Partitioning::NonUniform)
+    {
+      layout = &NonUniformConvolution::getLayoutHash;
+    }
+    SpectrumCache::Key key{hash, blockSize_, variant, layout};
+    cache = std::make_shared<SpectrumCache>(spectrumCachePath, key);
+  }
+
+  // cache hit => coeffs and spectra are mapped from cache, no parsing and no fft required
+  std::vector<std::vector<float>> coeffs;
+  std::vector<std::span<const float>> filters;
+  if(cache && cache->isHit())
+  {
+    filters = cache->getFilters();
+  }
+  else
+  {
+    // outputs of full scale +-1.0f, the sample format scales when storing
+    auto fileFilters = loadFIRCoeffs(path, 1.0f);
+
+    if(fileFilters.size() < routing_.getNumFilters())
+    {
+      throw std::invalid_argument("Error: " + path + " provides " + std::to_string(fileFilters.size()) +
+                                  " filters, routing needs " + std::to_string(routing_.getNumFilters()));
+    }
+
+    for(auto& route : routing_.getRoutes())
+    {
+      coeffs.push_back(fileFilters[route.filter]);
+      for(auto& c : coeffs.back())
+      {
+        c *= route.gain;
+      }
+    }
+    filters.assign(coeffs.begin(), coeffs.end());
+  }
+
+  assert(filters.size() == routing_.getRoutes().size() && "Cache needs to provide one filter per route");
+
+  std::vector<FirMultiChannelCrossover::ConfigType> config;
+  for(uint32_t i{0}; i < filters.size(); ++i)
+  {
+    config.push_back({routing_.getRoutes()[i].input, filters[i], partitioning, routing_.getOutput(i)});
+  }
 
-  std::vector<FirMultiChannelCrossover::ConfigType> config{{0, coeffs[0]},
-                                                           {0, coeffs[1]},
-                                                           {0, coeffs[2]},
-                                                           {1, coeffs[3]},
-                                                           {1, coeffs[4]},
-                                                           {1, coeffs[5]},
-                                                           {2, coeffs[6]}};
+  crossover_ = std::make_unique<FirMultiChannelCrossover>(
+      blockSize_, routing_.getNumInputs(), config, 3, cache, batchedFft, zeroLatency);
 
-  crossover_ = std::make_unique<FirMultiChannelCrossover>(blockSize_, 3, config, 3);
+  if(staticSchedule)
+  {
+    crossover_->compileSchedule();
+  }
 
-  for(auto i{0}; i < inputs_.size(); ++i)
+  // the logger is not open yet
+  if(cache && !cache->isHit() && !cache->store(filters))
   {
-    inputs_[i] = crossover_->getInputBuffer(i).data();
+    SNDERR("dxo: storing spectra to %s failed [%s]", spectrumCachePath.c_str(), strerror(errno));
   }
 
-  for(auto i{0}; i < outputs_.size(); ++i)
+  if(!wisdom.store())
   {
-    outputs_[i] = crossover_->getOutputBuffer(i).data();
+    SNDERR("dxo: storing fft wisdom to %s failed [%s]", fftWisdomPath.c_str(), strerror(errno));
   }
+
+  for(uint32_t i{0}; i < routing_.getNumInputs(); ++i)
+  {
+    inputs_.push_back(crossover_->getInputBuffer(i).data());
+  }
+
+  for(uint32_t i{0}; i < routing_.getNumOutputs(); ++i)
+  {
+    outputs_.push_back(crossover_->getOutputBuffer(i).data());
+  }
+
+  // until the slave reports its channel map
+  mapOutputChannels(routing_.getDefaultPositions());
+}
+
+AlsaPluginDxO::~AlsaPluginDxO()
+{
+  // normally stopped by dxo_close, error paths must not leave threads on a deleted plugin
+  stopOutputThread(false);
+  stopStatsExport();
 }
 
 std::vector<std::vector<float>> AlsaPluginDxO::loadFIRCoeffs(const std::string& path, float scale)
@@ -94,30 +182,71 @@ std::vector<std::vector<float>> AlsaPluginDxO::loadFIRCoeffs(const std::string&
   return filters;
 }
 
-void AlsaPluginDxO::enableLogging()
+std::vector<int32_t> AlsaPluginDxO::mapOutputChannels(const std::vector<uint32_t>& positions)
 {
-#ifdef BUILD_ARM
-  logging_.open("/storage/dxo.txt", std::ios::app | std::ios::out);
-#else
-  logging_.open("/home/malte/dxo.txt", std::ios::app | std::ios::out);
-#endif
+  auto map = routing_.mapChannels(positions);
+
+  channelOutputs_.clear();
+  for(auto output : map)
+  {
+    channelOutputs_.push_back(output >= 0 ? outputs_[output] : silence_.data());
+  }
+
+  return map;
+}
+
+// no log_file => logging disabled
+void AlsaPluginDxO::enableLogging(const AsyncLogger::Config& config)
+{
+  if(!logger_.open(config))
+  {
+    SNDERR("dxo: opening log file %s failed [%s]", config.path.c_str(), strerror(errno));
+  }
 }
 
-bool AlsaPluginDxO::writePcm(const int16_t* data, const uint32_t frames)
+void AlsaPluginDxO::configureRealtime(const ThreadConfig& config, bool lockMemory)
 {
-  auto result = snd_pcm_writei(pcm_output_device_, data, frames);
+  // output thread runs with the same policy, it may run on any cpu
+  outputThreadConfig_.policy = config.policy;
+  outputThreadConfig_.priority = config.priority;
 
+  if(!config.isDefault())
+  {
+    if(auto error = crossover_->configureThreads(config))
+    {
+      log(LogLevel::Warning,
+          "worker scheduling/affinity failed [",
+          strerror(error),
+          "] => running with default settings");
+    }
+  }
+
+  // buffers and worker stacks exist at this point, MCL_FUTURE would also pin every later
+  // allocation of the host application
+  if(lockMemory && mlockall(MCL_CURRENT) != 0)
+  {
+    log(LogLevel::Warning, "mlockall failed [", strerror(errno), "] => memory may be paged out");
+  }
+}
+
+bool AlsaPluginDxO::checkWrite(snd_pcm_sframes_t result, snd_pcm_uframes_t frames)
+{
   if(result != frames)
   {
     if(result < 0)
     {
-      print("write error [", snd_strerror(result), "]");
+      log(LogLevel::Error, "write error [", snd_strerror(result), "]");
     }
     else
     {
-      print("incomplete write ", result, "/", frames);
+      log(LogLevel::Error, "incomplete write ", result, "/", frames);
     }
 
+    if(result == -EPIPE)
+    {
+      xruns_.fetch_add(1, std::memory_order_relaxed);
+    }
+    recoveries_.fetch_add(1, std::memory_order_relaxed);
     snd_pcm_recover(pcm_output_device_, result, 0);
 
     return false;
@@ -126,6 +255,241 @@ bool AlsaPluginDxO::writePcm(const int16_t* data, const uint32_t frames)
   return true;
 }
 
+void AlsaPluginDxO::printStats()
+{
+  auto stats = getStats();
+
+  // us, p99.9 is what decides about xruns, not the mean
+  auto printTime = [this](const char* name, const LatencyHistogram::Snapshot& time) {
+    print(name, " blocks: ", time.count, " mean: ", time.meanNs() * 1e-3);
+    print("  p50: ", time.percentileNs(0.5) * 1e-3, " p99: ", time.percentileNs(0.99) * 1e-3);
+    print("  p99.9: ", time.percentileNs(0.999) * 1e-3, " max: ", time.maxNs * 1e-3);
+  };
+
+  printTime("process time [us]", stats.processTime);
+  printTime("write time [us]", stats.writeTime);
+  print("deadline misses: ", stats.deadlineMisses);
+  print("xruns: ", stats.xruns, " recoveries: ", stats.recoveries);
+}
+
+bool AlsaPluginDxO::startStatsExport(const std::string& name, std::chrono::milliseconds period)
+{
+  statsShm_ = StatsShm::create(name);
+  if(!statsShm_)
+  {
+    log(LogLevel::Warning, "stats export to ", name, " failed [", strerror(errno), "]");
+    return false;
+  }
+
+  // run time per task label for the export, process wide => shared by all plugin instances
+  TaskProfiler::global().enableLabelTiming();
+
+  statsThread_ = std::thread([this, period] {
+    // may be spawned by a realtime thread => monitoring must not compete with the audio
+    sched_param param{};
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+    do
+    {
+      publishStats();
+    } while(!statsStop_.try_acquire_for(period));
+  });
+
+  return true;
+}
+
+void AlsaPluginDxO::stopStatsExport()
+{
+  if(!statsThread_.joinable())
+  {
+    return;
+  }
+
+  statsStop_.release();
+  statsThread_.join();
+  statsShm_.reset();
+  TaskProfiler::global().disableLabelTiming();
+}
+
+void AlsaPluginDxO::publishStats()
+{
+  auto stats = getStats();
+  auto cpuTimes = crossover_->getWorkerCpuTimes();
+
+  DxoStats shared{};
+  timespec now{};
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  shared.timeNs = now.tv_sec * 1000000000ULL + now.tv_nsec;
+  shared.pid = getpid();
+  shared.blockSize = blockSize_;
+  shared.deadlineNs = deadline_.load(std::memory_order_relaxed).count();
+  shared.deadlineMisses = stats.deadlineMisses;
+  shared.xruns = stats.xruns;
+  shared.recoveries = stats.recoveries;
+  shared.processTime = stats.processTime;
+  shared.writeTime = stats.writeTime;
+  shared.numWorkers = std::min<uint32_t>(cpuTimes.size(), DxoStats::kMaxWorkers);
+  for(uint32_t i{0}; i < shared.numWorkers; ++i)
+  {
+    shared.workerCpuNs[i] = cpuTimes[i].count();
+  }
+
+  auto taskTimes = TaskProfiler::global().getLabelTimes();
+  shared.numTasks = std::min<uint32_t>(taskTimes.size(), DxoStats::kMaxTasks);
+  for(uint32_t i{0}; i < shared.numTasks; ++i)
+  {
+    auto& task = shared.tasks[i];
+    taskTimes[i].label.copy(task.label, sizeof(task.label) - 1);
+    task.count = taskTimes[i].count;
+    task.totalNs = taskTimes[i].totalNs;
+    task.maxNs = taskTimes[i].maxNs;
+  }
+
+  statsShm_->publish(shared);
+}
+
+void AlsaPluginDxO::writeProfile()
+{
+  if(!kTaskProfiling || profileTrace_.length() == 0)
+  {
+    return;
+  }
+
+  auto& profiler = TaskProfiler::global();
+  std::ofstream trace(profileTrace_);
+  profiler.writeChromeTrace(trace);
+
+  auto paths = profiler.getCriticalPaths();
+  if(paths.size() == 0)
+  {
+    return;
+  }
+
+  int64_t wallNs{0};
+  int64_t lengthNs{0};
+  for(auto& path : paths)
+  {
+    wallNs += path.wallNs;
+    lengthNs += path.lengthNs;
+  }
+
+  // us per block
+  print("profile of ", paths.size(), " blocks written to ", profileTrace_);
+  print("critical path: ", lengthNs * 1e-3 / paths.size(), " wall: ", wallNs * 1e-3 / paths.size());
+  for(auto& stats : profiler.getLabelStats())
+  {
+    print("  ",
+          stats.label,
+          " runs: ",
+          stats.count,
+          " mean: ",
+          stats.totalNs * 1e-3 / stats.count,
+          " max: ",
+          stats.maxNs * 1e-3,
+          " critical: ",
+          stats.criticalNs * 1e-3 / paths.size());
+  }
+}
+
+void AlsaPluginDxO::startOutputThread()
+{
+  frameBytes_ = channels * snd_pcm_format_physical_width(format) / 8;
+  ring_ = std::make_unique<SpscRing<uint8_t>>(std::max(asyncDepth_, blockSize_) * frameBytes_);
+  acceptedFrames_ = 0;
+  outputStop_ = false;
+  outputThread_ = std::thread([this] { outputThreadRun(); });
+}
+
+void AlsaPluginDxO::stopOutputThread(bool drain)
+{
+  if(!outputThread_.joinable())
+  {
+    return;
+  }
+
+  outputDrain_ = drain;
+  outputStop_ = true;
+  ++dataEpoch_;
+  dataEpoch_.notify_one();
+  outputThread_.join();
+}
+
+void AlsaPluginDxO::outputThreadRun()
+{
+  if(auto error = outputThreadConfig_.apply(pthread_self(), 0))
+  {
+    log(LogLevel::Warning,
+        "output thread scheduling failed [",
+        strerror(error),
+        "] => running with default settings");
+  }
+
+  const auto writer = [this](uint32_t frames, const auto& store) { return writePcm(frames, store); };
+
+  while(true)
+  {
+    // load epoch before checking the ring => an enqueue in between changes it and wait returns
+    auto epoch = dataEpoch_.load();
+
+    auto data = ring_->readable();
+    uint32_t frames = data.size() / frameBytes_;
+
+    // frames the client saw accepted are written out before a drained stop
+    if(outputStop_ && (!outputDrain_ || frames == 0))
+    {
+      return;
+    }
+
+    if(frames == 0)
+    {
+      dataEpoch_.wait(epoch);
+      continue;
+    }
+
+    if(format == SND_PCM_FORMAT_S16_LE)
+    {
+      PcmStream<int16_t> src(reinterpret_cast<int16_t*>(data.data()), channels);
+      update(src, frames, channels, writer);
+    }
+    else if(format == SND_PCM_FORMAT_FLOAT_LE)
+    {
+      PcmStream<float> src(reinterpret_cast<float*>(data.data()), channels);
+      update(src, frames, channels, writer);
+    }
+
+    ring_->consume(frames * frameBytes_);
+    ++spaceEpoch_;
+    spaceEpoch_.notify_one();
+  }
+}
+
+snd_pcm_uframes_t AlsaPluginDxO::enqueue(const snd_pcm_channel_area_t* areas,
+                                         snd_pcm_uframes_t offset,
+                                         snd_pcm_uframes_t size)
+{
+  auto data = static_cast<const uint8_t*>(snd_pcm_channel_area_addr(areas, offset));
+
+  // ring capacity and writes are whole frames => a partial write still ends on a frame
+  snd_pcm_uframes_t written{0};
+  while(written == 0 && size > 0)
+  {
+    auto epoch = spaceEpoch_.load();
+    written = ring_->write(data, size * frameBytes_) / frameBytes_;
+
+    // slave stalled for longer than the ring holds => block the client
+    if(written == 0)
+    {
+      spaceEpoch_.wait(epoch);
+    }
+  }
+
+  acceptedFrames_ += written;
+  ++dataEpoch_;
+  dataEpoch_.notify_one();
+
+  return written;
+}
+
 extern "C" {
 
 snd_pcm_sframes_t AlsaPluginDxO::dxo_pointer(snd_pcm_ioplug_t* io)
@@ -141,19 +505,24 @@ snd_pcm_sframes_t AlsaPluginDxO::dxo_transfer(snd_pcm_ioplug_t* io,
 {
   auto* plugin = reinterpret_cast<AlsaPluginDxO*>(io);
 
-  const auto writer = [plugin](const int16_t* data, uint32_t frames) {
-    return plugin->writePcm(data, frames);
+  if(plugin->ring_)
+  {
+    return plugin->enqueue(src_areas, src_offset, size);
+  }
+
+  const auto writer = [plugin](uint32_t frames, const auto& store) {
+    return plugin->writePcm(frames, store);
   };
 
   if(io->format == SND_PCM_FORMAT_S16_LE)
   {
     PcmStream<int16_t> src(src_areas, src_offset);
-    plugin->update(src, size, io->channels == 3, writer);
+    plugin->update(src, size, io->channels, writer);
   }
   else if(io->format == SND_PCM_FORMAT_FLOAT_LE)
   {
     PcmStream<float> src(src_areas, src_offset);
-    plugin->update(src, size, io->channels == 3, writer);
+    plugin->update(src, size, io->channels, writer);
   }
 
   return size;
@@ -172,7 +541,7 @@ int AlsaPluginDxO::dxo_try_open_device(AlsaPluginDxO* plugin)
   if(result < 0)
   {
     plugin->pcm_output_device_ = nullptr;
-    plugin->print("snd_pcm_open failed ", snd_strerror(result));
+    plugin->log(LogLevel::Error, "snd_pcm_open failed ", snd_strerror(result));
     return -EBUSY;
   }
 
@@ -183,36 +552,86 @@ int AlsaPluginDxO::dxo_try_open_device(AlsaPluginDxO* plugin)
   snd_pcm_hw_params_any(plugin->pcm_output_device_, params);
   // snd_pcm_hw_params_dump(params, plugin->output_);
 
-  if(snd_pcm_hw_params_set_access(plugin->pcm_output_device_, params, SND_PCM_ACCESS_RW_INTERLEAVED) < 0)
+  // mmap => outputs are converted straight into the buffer of the slave
+  plugin->mmapOutput_ =
+      snd_pcm_hw_params_set_access(plugin->pcm_output_device_, params, SND_PCM_ACCESS_MMAP_INTERLEAVED) >= 0;
+
+  if(!plugin->mmapOutput_ &&
+     snd_pcm_hw_params_set_access(plugin->pcm_output_device_, params, SND_PCM_ACCESS_RW_INTERLEAVED) < 0)
   {
-    plugin->print("snd_pcm_hw_params_set_access failed");
+    plugin->log(LogLevel::Error, "snd_pcm_hw_params_set_access failed");
+  }
+
+  // widest format the slave takes natively, float outputs are converted once in the store kernels
+  static constexpr snd_pcm_format_t kOutputFormats[] = {SND_PCM_FORMAT_S32_LE,
+                                                        SND_PCM_FORMAT_S24_LE,
+                                                        SND_PCM_FORMAT_S24_3LE,
+                                                        SND_PCM_FORMAT_FLOAT_LE,
+                                                        SND_PCM_FORMAT_S16_LE};
+
+  bool hasFormat{false};
+  for(auto format : kOutputFormats)
+  {
+    if(plugin->outputFormat_ != SND_PCM_FORMAT_UNKNOWN && plugin->outputFormat_ != format)
+    {
+      continue;
+    }
+
+    if(snd_pcm_hw_params_set_format(plugin->pcm_output_device_, params, format) >= 0)
+    {
+      plugin->outputFormat_ = format;
+      hasFormat = true;
+      break;
+    }
+  }
+
+  // writing a format the slave did not take is garbage at full scale => fail the open
+  if(!hasFormat)
+  {
+    plugin->log(LogLevel::Error,
+                "snd_pcm_hw_params_set_format failed for ",
+                plugin->outputFormat_ != SND_PCM_FORMAT_UNKNOWN ? snd_pcm_format_name(plugin->outputFormat_)
+                                                                : "any supported format");
+    snd_pcm_close(plugin->pcm_output_device_);
+    plugin->pcm_output_device_ = nullptr;
+    return -EINVAL;
   }
 
-  if(snd_pcm_hw_params_set_format(plugin->pcm_output_device_, params, SND_PCM_FORMAT_S16_LE) < 0)
+  plugin->print("output format ", snd_pcm_format_name(plugin->outputFormat_));
+
+  const uint32_t numChannels = plugin->routing_.getNumOutputChannels();
+
+  if(!plugin->mmapOutput_)
   {
-    plugin->print("snd_pcm_hw_params_set_format failed");
+    const uint32_t width = snd_pcm_format_physical_width(plugin->outputFormat_);
+    plugin->outputBuffer_.reset(new uint8_t[plugin->blockSize_ * numChannels * width / 8]);
+
+    plugin->outputAreas_.resize(numChannels);
+    for(uint32_t i{0}; i < numChannels; ++i)
+    {
+      plugin->outputAreas_[i] = {plugin->outputBuffer_.get(), i * width, numChannels * width};
+    }
   }
 
-  if(snd_pcm_hw_params_set_channels(plugin->pcm_output_device_, params, AlsaPluginDxO::kNumOutputChannels) <
-     0)
+  if(snd_pcm_hw_params_set_channels(plugin->pcm_output_device_, params, numChannels) < 0)
   {
-    plugin->print("snd_pcm_hw_params_set_channels failed");
+    plugin->log(LogLevel::Error, "snd_pcm_hw_params_set_channels failed");
   }
 
   uint32_t rate = plugin->rate;
   if(snd_pcm_hw_params_set_rate_near(plugin->pcm_output_device_, params, &rate, 0) < 0)
   {
-    plugin->print("snd_pcm_hw_params_set_rate_near failed");
+    plugin->log(LogLevel::Error, "snd_pcm_hw_params_set_rate_near failed");
   }
 
   if(snd_pcm_hw_params_set_period_size(plugin->pcm_output_device_, params, plugin->blockSize_, 0) < 0)
   {
-    plugin->print("snd_pcm_hw_params_set_period_size failed");
+    plugin->log(LogLevel::Error, "snd_pcm_hw_params_set_period_size failed");
   }
 
   if(snd_pcm_hw_params(plugin->pcm_output_device_, params) < 0)
   {
-    plugin->print("snd_pcm_hw_params failed");
+    plugin->log(LogLevel::Error, "snd_pcm_hw_params failed");
     snd_pcm_close(plugin->pcm_output_device_);
     plugin->pcm_output_device_ = nullptr;
     return -EINVAL;
@@ -222,10 +641,15 @@ int AlsaPluginDxO::dxo_try_open_device(AlsaPluginDxO* plugin)
 
   if(chMap)
   {
-    for(auto i{0}; i < chMap[0].channels; ++i)
+    // positions of the routes => slave channels, channels the map does not cover have none
+    std::vector<uint32_t> positions(chMap->pos, chMap->pos + std::min(chMap->channels, numChannels));
+    positions.resize(numChannels, SND_CHMAP_UNKNOWN);
+    free(chMap);
+
+    auto map = plugin->mapOutputChannels(positions);
+    for(uint32_t i{0}; i < numChannels; ++i)
     {
-      plugin->channelMap_[i] = kMapAlsaChannel[chMap[0].pos[i]];
-      plugin->print("CHMAP[", i, "]: ", chMap[0].pos[i], "  -> ", plugin->channelMap_[i]);
+      plugin->log(LogLevel::Debug, "CHMAP[", i, "]: ", positions[i], "  -> output ", map[i]);
     }
   }
 
@@ -235,9 +659,21 @@ int AlsaPluginDxO::dxo_try_open_device(AlsaPluginDxO* plugin)
 int AlsaPluginDxO::dxo_prepare(snd_pcm_ioplug_t* io)
 {
   auto* plugin = reinterpret_cast<AlsaPluginDxO*>(io);
-  plugin->print("dxo_prepare");
+  plugin->log(LogLevel::Debug, "dxo_prepare");
+
+  // output thread touches the stream state => stop before the reset, queued frames belong
+  // to the stream that is reset
+  plugin->stopOutputThread(false);
   plugin->streamPos_ = 0;
   plugin->inputOffset_ = 0;
+  plugin->deadline_ = std::chrono::nanoseconds(
+      plugin->rate > 0 ? static_cast<int64_t>(1e9 * plugin->blockSize_ / plugin->rate) : 0);
+
+  if(plugin->asyncDepth_ > 0)
+  {
+    plugin->startOutputThread();
+  }
+
   return 0;
 }
 
@@ -245,8 +681,14 @@ int AlsaPluginDxO::dxo_close(snd_pcm_ioplug_t* io)
 {
   auto* plugin = reinterpret_cast<AlsaPluginDxO*>(io);
 
-  plugin->print("dxo_close");
-  plugin->print("avg time: ", plugin->totalTime_ / plugin->totalBlocks_);
+  plugin->log(LogLevel::Debug, "dxo_close");
+  plugin->stopOutputThread(true);
+  plugin->stopStatsExport();
+  plugin->printStats();
+  plugin->writeProfile();
+
+  auto waitStats = plugin->crossover_->getWaitStats();
+  plugin->print("worker spin hits: ", waitStats.spinHits, " sleeps: ", waitStats.sleeps);
 
   if(plugin->pcm_output_device_)
   {
@@ -273,14 +715,14 @@ const int32_t kNumChannelMaps = std::size(kChannelMaps);
 snd_pcm_chmap_query_t** AlsaPluginDxO::dxo_query_chmaps(snd_pcm_ioplug_t* io)
 {
   auto* plugin = reinterpret_cast<AlsaPluginDxO*>(io);
-  plugin->print("dxo_query_chmaps");
+  plugin->log(LogLevel::Debug, "dxo_query_chmaps");
 
   auto maps =
       static_cast<snd_pcm_chmap_query_t**>(malloc(sizeof(snd_pcm_chmap_query_t*) * (kNumChannelMaps + 1)));
 
   if(!maps)
   {
-    plugin->print("  invalid maps");
+    plugin->log(LogLevel::Debug, "  invalid maps");
     return nullptr;
   }
 
@@ -291,7 +733,7 @@ snd_pcm_chmap_query_t** AlsaPluginDxO::dxo_query_chmaps(snd_pcm_ioplug_t* io)
 
     if(maps[i] == nullptr)
     {
-      plugin->print("  invalid maps[i]");
+      plugin->log(LogLevel::Debug, "  invalid maps[i]");
       snd_pcm_free_chmaps(maps);
       return nullptr;
     }
@@ -310,15 +752,19 @@ snd_pcm_chmap_t* AlsaPluginDxO::dxo_get_chmap(snd_pcm_ioplug_t* io)
 {
   auto* plugin = reinterpret_cast<AlsaPluginDxO*>(io);
 
-  auto map =
-      static_cast<snd_pcm_chmap_t*>(malloc(sizeof(snd_pcm_chmap_t) + sizeof(kChannelMaps[0].channels)));
+  auto map = static_cast<snd_pcm_chmap_t*>(malloc(sizeof(snd_pcm_chmap_t) + plugin->channels * sizeof(int)));
 
   if(map)
   {
+    // inputs beyond the known layouts have no position
     const auto map_index =
         std::min(std::max(static_cast<int32_t>(plugin->channels) - 2, 0), kNumChannelMaps - 1);
     map->channels = plugin->channels;
-    memcpy(map->pos, kChannelMaps[map_index].channels.data(), sizeof(kChannelMaps[0].channels));
+    for(uint32_t i{0}; i < plugin->channels; ++i)
+    {
+      map->pos[i] = i < kChannelMaps[map_index].channels.size() ? kChannelMaps[map_index].channels[i]
+                                                                 : SND_CHMAP_UNKNOWN;
+    }
   }
 
   return map;
@@ -327,7 +773,7 @@ snd_pcm_chmap_t* AlsaPluginDxO::dxo_get_chmap(snd_pcm_ioplug_t* io)
 int AlsaPluginDxO::dxo_hw_params(snd_pcm_ioplug_t* io, snd_pcm_hw_params_t* params)
 {
   auto* plugin = reinterpret_cast<AlsaPluginDxO*>(io);
-  plugin->print("dxo_hw_params");
+  plugin->log(LogLevel::Debug, "dxo_hw_params");
 
   snd_pcm_hw_params_get_rate(params, &plugin->rate, 0);
   snd_pcm_hw_params_get_channels(params, &plugin->channels);
@@ -347,11 +793,23 @@ int AlsaPluginDxO::dxo_delay(snd_pcm_ioplug_t* io, snd_pcm_sframes_t* delayp)
   const auto result = snd_pcm_delay(plugin->pcm_output_device_, &slaveDelay);
   if(result < 0)
   {
-    plugin->print("snd_pcm_delay failed!");
+    plugin->log(LogLevel::Error, "snd_pcm_delay failed!");
     return result;
   }
 
-  const auto convDelay = plugin->blockSize_ - plugin->inputOffset_;
+  // zero latency => each frame is written out with the transfer that brings it
+  const bool zeroLatency = plugin->crossover_->isZeroLatency();
+  snd_pcm_sframes_t convDelay = zeroLatency ? 0 : plugin->blockSize_ - plugin->inputOffset_;
+
+  if(plugin->ring_)
+  {
+    // inputOffset_ belongs to the output thread => derive it from the frame counters
+    snd_pcm_sframes_t queued = plugin->ring_->size() / plugin->frameBytes_;
+    snd_pcm_sframes_t pending = static_cast<uint32_t>(plugin->acceptedFrames_ - plugin->streamPos_);
+    auto inputOffset = std::clamp<snd_pcm_sframes_t>(pending - queued, 0, plugin->blockSize_);
+    convDelay = (zeroLatency ? 0 : plugin->blockSize_ - inputOffset) + queued;
+  }
+
   *delayp = slaveDelay + plugin->firDelay_ + convDelay;
 
   return 0;
@@ -372,11 +830,52 @@ static const snd_pcm_ioplug_callback_t callbacks = {
 #endif
 };
 
+// $XDG_CACHE_HOME/dxo or ~/.cache/dxo, created if missing, empty if there is neither
+static std::string getCacheDir()
+{
+  std::string base;
+  if(auto xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+  {
+    base = xdg;
+  }
+  else if(auto home = std::getenv("HOME"); home && *home)
+  {
+    base = std::string(home) + "/.cache";
+  }
+  else
+  {
+    return "";
+  }
+
+  std::error_code error;
+  std::filesystem::create_directories(base + "/dxo", error);
+  return error ? "" : base + "/dxo";
+}
+
 SND_PCM_PLUGIN_DEFINE_FUNC(dxo)
 {
   long int blockSize = 128;
   long int firDelay = 0;  // ignore fir delay by default
+  auto partitioning = FirMultiChannelCrossover::Partitioning::Uniform;
   std::string coeffPath;
+  std::string spectrumCachePath;
+  bool hasSpectrumCachePath = false;
+  std::string fftWisdomPath;
+  bool hasFftWisdomPath = false;
+  bool staticSchedule = false;
+  bool batchedFft = false;
+  bool zeroLatency = false;
+  ThreadConfig threadConfig;
+  long int rtPriority = 0;  // 0 => keep default scheduling
+  std::string rtPolicy = "fifo";
+  bool lockMemory = false;
+  long int asyncDepth = 0;  // 0 => write to the slave within transfer
+  auto outputFormat = SND_PCM_FORMAT_UNKNOWN;  // negotiated with the slave
+  std::string routingSpec;
+  long int outputChannels = 0;  // 0 => as many as the routes need
+  std::string statsShm;  // empty => no stats export
+  AsyncLogger::Config logConfig;  // empty path => platform default
+  std::string profileTrace;
   std::string slavePcm;
   snd_config_t* slaveConfig = nullptr;
 
@@ -422,6 +921,17 @@ SND_PCM_PLUGIN_DEFINE_FUNC(dxo)
       continue;
     }
 
+    if(param == "partitioning")
+    {
+      const char* str;
+      snd_config_get_string(config, &str);
+      if(std::string(str) == "nonuniform")
+      {
+        partitioning = FirMultiChannelCrossover::Partitioning::NonUniform;
+      }
+      continue;
+    }
+
     if(param == "path")
     {
       const char* path;
@@ -429,6 +939,188 @@ SND_PCM_PLUGIN_DEFINE_FUNC(dxo)
       coeffPath = path;
       continue;
     }
+
+    if(param == "spectrum_cache")
+    {
+      const char* path;
+      snd_config_get_string(config, &path);
+      spectrumCachePath = path;
+      hasSpectrumCachePath = true;
+      continue;
+    }
+
+    if(param == "fft_wisdom")
+    {
+      const char* path;
+      snd_config_get_string(config, &path);
+      fftWisdomPath = path;
+      hasFftWisdomPath = true;
+      continue;
+    }
+
+    if(param == "rt_priority")
+    {
+      snd_config_get_integer(config, &rtPriority);
+      rtPriority = std::clamp(rtPriority, 0L, 99L);
+      continue;
+    }
+
+    if(param == "rt_policy")
+    {
+      const char* str;
+      snd_config_get_string(config, &str);
+      rtPolicy = str;
+      continue;
+    }
+
+    if(param == "cpu_affinity")
+    {
+      const char* str;
+      snd_config_get_string(config, &str);
+      try
+      {
+        threadConfig.cpus = ThreadConfig::parseCpus(str);
+      }
+      catch(const std::exception&)
+      {
+        return -EINVAL;
+      }
+      continue;
+    }
+
+    if(param == "spin_time")
+    {
+      long int spinTimeUs = 0;
+      snd_config_get_integer(config, &spinTimeUs);
+      threadConfig.spinTime = std::chrono::microseconds(std::max(0L, spinTimeUs));
+      continue;
+    }
+
+    if(param == "async_depth")
+    {
+      snd_config_get_integer(config, &asyncDepth);
+      asyncDepth = std::max(0L, asyncDepth);
+      continue;
+    }
+
+    if(param == "output_format")
+    {
+      const char* str;
+      snd_config_get_string(config, &str);
+      outputFormat = snd_pcm_format_value(str);
+
+      // a typo must not silently fall back to auto (UNKNOWN), no plugin log exists yet
+      if(outputFormat == SND_PCM_FORMAT_UNKNOWN)
+      {
+        SNDERR("dxo: unknown output_format %s", str);
+        return -EINVAL;
+      }
+      continue;
+    }
+
+    if(param == "routing")
+    {
+      const char* str;
+      snd_config_get_string(config, &str);
+      routingSpec = str;
+      continue;
+    }
+
+    if(param == "output_channels")
+    {
+      snd_config_get_integer(config, &outputChannels);
+      outputChannels = std::max(0L, outputChannels);
+      continue;
+    }
+
+    if(param == "zero_latency")
+    {
+      zeroLatency = snd_config_get_bool(config) > 0;
+      continue;
+    }
+
+    if(param == "batched_fft")
+    {
+      batchedFft = snd_config_get_bool(config) > 0;
+      continue;
+    }
+
+    if(param == "log_file")
+    {
+      const char* str;
+      snd_config_get_string(config, &str);
+      logConfig.path = str;
+      continue;
+    }
+
+    if(param == "log_level")
+    {
+      const char* str;
+      snd_config_get_string(config, &str);
+      try
+      {
+        logConfig.level = AsyncLogger::parseLevel(str);
+      }
+      catch(const std::exception&)
+      {
+        return -EINVAL;
+      }
+      continue;
+    }
+
+    if(param == "log_rate")
+    {
+      long int rate = 0;
+      snd_config_get_integer(config, &rate);
+      logConfig.rateLimit = std::max(0L, rate);
+      continue;
+    }
+
+    if(param == "log_size")
+    {
+      long int size = 0;
+      snd_config_get_integer(config, &size);
+      logConfig.maxFileSize = std::max(0L, size);
+      continue;
+    }
+
+    if(param == "log_files")
+    {
+      long int files = 0;
+      snd_config_get_integer(config, &files);
+      logConfig.numFiles = std::max(0L, files);
+      continue;
+    }
+
+    if(param == "profile_trace")
+    {
+      const char* str;
+      snd_config_get_string(config, &str);
+      profileTrace = str;
+      continue;
+    }
+
+    if(param == "stats_shm")
+    {
+      const char* str;
+      snd_config_get_string(config, &str);
+      statsShm = str;
+      continue;
+    }
+
+    if(param == "mlock")
+    {
+      lockMemory = snd_config_get_bool(config) > 0;
+      continue;
+    }
+
+    if(param == "scheduling")
+    {
+      const char* str;
+      snd_config_get_string(config, &str);
+      staticSchedule = std::string(str) == "static";
+      continue;
+    }
   }
 
   if(slavePcm.length() == 0)
@@ -436,17 +1128,94 @@ SND_PCM_PLUGIN_DEFINE_FUNC(dxo)
     return -EINVAL;
   }
 
-  AlsaPluginDxO* plugin = new AlsaPluginDxO(coeffPath, blockSize, firDelay, slavePcm, &callbacks);
-  plugin->enableLogging();
+  // spectra and wisdom are cached in the user cache dir by default (the coeffs usually sit in a
+  // read-only location), next to the coeffs without one; an empty path disables them
+  if(!hasSpectrumCachePath || !hasFftWisdomPath)
+  {
+    auto cacheDir = getCacheDir();
+    auto coeffName = std::filesystem::path(coeffPath).filename().string();
+
+    if(!hasSpectrumCachePath)
+    {
+      spectrumCachePath = cacheDir.length() > 0 ? cacheDir + "/" + coeffName : coeffPath;
+      spectrumCachePath += ".spectra";
+    }
+
+    // wisdom does not depend on the coeffs => one file for all of them
+    if(!hasFftWisdomPath)
+    {
+      fftWisdomPath = cacheDir.length() > 0 ? cacheDir + "/fft.wisdom" : coeffPath + ".wisdom";
+    }
+  }
+
+  // routes of the config, else of the coeffs file header, else the 3 in/7 filter layout
+  Routing routing;
+  try
+  {
+    routing = routingSpec.length() > 0 ? Routing::parse(routingSpec) : Routing::load(coeffPath);
+  }
+  catch(const std::exception&)
+  {
+    return -EINVAL;
+  }
+
+  if(routing.empty())
+  {
+    routing = Routing::getDefault();
+  }
+
+  routing.setNumOutputChannels(outputChannels);
+
+  if(routing.getNumInputs() > AlsaPluginDxO::kMaxInputChannels ||
+     routing.getNumOutputChannels() > AlsaPluginDxO::kMaxOutputChannels)
+  {
+    return -EINVAL;
+  }
+
+  if(rtPriority > 0)
+  {
+    threadConfig.policy = rtPolicy == "rr" ? SCHED_RR : SCHED_FIFO;
+    threadConfig.priority = rtPriority;
+  }
+
+  // coeffs that do not load or do not fit the routing
+  AlsaPluginDxO* plugin = nullptr;
+  try
+  {
+    plugin = new AlsaPluginDxO(coeffPath,
+                               blockSize,
+                               firDelay,
+                               slavePcm,
+                               &callbacks,
+                               partitioning,
+                               spectrumCachePath,
+                               fftWisdomPath,
+                               staticSchedule,
+                               asyncDepth,
+                               outputFormat,
+                               routing,
+                               batchedFft,
+                               zeroLatency);
+  }
+  catch(const std::exception& e)
+  {
+    SNDERR("dxo: %s", e.what());
+    return -EINVAL;
+  }
+  plugin->enableLogging(logConfig);
+  plugin->setProfileTrace(profileTrace);
+  plugin->configureRealtime(threadConfig, lockMemory);
 
   auto result = snd_pcm_ioplug_create(plugin, name, stream, mode);
 
   if(result < 0)
   {
-    plugin->print("snd_pcm_ioplug_create failed");
+    plugin->log(LogLevel::Error, "snd_pcm_ioplug_create failed");
+    delete plugin;
     return result;
   }
 
+  // from here closing the ioplug deletes the plugin (dxo_close)
   static constexpr uint32_t supportedAccess[] = {SND_PCM_ACCESS_RW_INTERLEAVED};
   static constexpr uint32_t supportedFormats[] = {SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_FLOAT_LE};
   static constexpr uint32_t supportedHwRates[] = {44100, 48000};
@@ -454,48 +1223,64 @@ SND_PCM_PLUGIN_DEFINE_FUNC(dxo)
   if(snd_pcm_ioplug_set_param_list(
          plugin, SND_PCM_IOPLUG_HW_ACCESS, std::size(supportedAccess), supportedAccess) < 0)
   {
-    plugin->print("SND_PCM_IOPLUG_HW_ACCESS failed");
+    plugin->log(LogLevel::Error, "SND_PCM_IOPLUG_HW_ACCESS failed");
+    snd_pcm_ioplug_delete(plugin);
     return -EINVAL;
   }
 
   if(snd_pcm_ioplug_set_param_list(
          plugin, SND_PCM_IOPLUG_HW_FORMAT, std::size(supportedFormats), supportedFormats) < 0)
   {
-    plugin->print("SND_PCM_IOPLUG_HW_FORMAT failed");
+    plugin->log(LogLevel::Error, "SND_PCM_IOPLUG_HW_FORMAT failed");
+    snd_pcm_ioplug_delete(plugin);
     return -EINVAL;
   }
 
-  if(snd_pcm_ioplug_set_param_minmax(plugin, SND_PCM_IOPLUG_HW_CHANNELS, 2, 3) < 0)
+  // missing inputs are mixed from the given ones, e.g. stereo into a 3 input routing
+  const uint32_t numInputs = routing.getNumInputs();
+  auto minChannels = std::min(2U, numInputs);
+  if(snd_pcm_ioplug_set_param_minmax(plugin, SND_PCM_IOPLUG_HW_CHANNELS, minChannels, numInputs) < 0)
   {
-    plugin->print("SND_PCM_IOPLUG_HW_CHANNELS failed");
+    plugin->log(LogLevel::Error, "SND_PCM_IOPLUG_HW_CHANNELS failed");
+    snd_pcm_ioplug_delete(plugin);
     return -EINVAL;
   }
 
   if(snd_pcm_ioplug_set_param_minmax(plugin, SND_PCM_IOPLUG_HW_PERIOD_BYTES, 16 * 1024, 2 * 1024 * 1024) < 0)
   {
-    plugin->print("SND_PCM_IOPLUG_HW_PERIOD_BYTES failed");
+    plugin->log(LogLevel::Error, "SND_PCM_IOPLUG_HW_PERIOD_BYTES failed");
+    snd_pcm_ioplug_delete(plugin);
     return -EINVAL;
   }
 
   if(snd_pcm_ioplug_set_param_minmax(plugin, SND_PCM_IOPLUG_HW_BUFFER_BYTES, 16, 2 * 1024 * 1024) < 0)
   {
-    plugin->print("SND_PCM_IOPLUG_HW_BUFFER_BYTES failed");
+    plugin->log(LogLevel::Error, "SND_PCM_IOPLUG_HW_BUFFER_BYTES failed");
+    snd_pcm_ioplug_delete(plugin);
     return -EINVAL;
   }
 
   if(snd_pcm_ioplug_set_param_list(
          plugin, SND_PCM_IOPLUG_HW_RATE, std::size(supportedHwRates), supportedHwRates) < 0)
   {
-    plugin->print("SND_PCM_IOPLUG_HW_RATE failed");
+    plugin->log(LogLevel::Error, "SND_PCM_IOPLUG_HW_RATE failed");
+    snd_pcm_ioplug_delete(plugin);
     return -EINVAL;
   }
 
   if(snd_pcm_ioplug_set_param_minmax(plugin, SND_PCM_IOPLUG_HW_PERIODS, 1, 1024) < 0)
   {
-    plugin->print("SND_PCM_IOPLUG_HW_PERIODS failed");
+    plugin->log(LogLevel::Error, "SND_PCM_IOPLUG_HW_PERIODS failed");
+    snd_pcm_ioplug_delete(plugin);
     return -EINVAL;
   }
 
+  // only for a plugin that is handed out => dxo_close stops it
+  if(statsShm.length() > 0)
+  {
+    plugin->startStatsExport(statsShm);
+  }
+
   *pcmp = plugin->pcm;
 
   plugin->print("SND_PCM_PLUGIN_DEFINE_FUNC: Ok");
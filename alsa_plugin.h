@@ -8,75 +8,259 @@
 #include <chrono>
 #include <fstream>
 #include <iomanip>
+#include <semaphore>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "async_logger.h"
+#include "crossover/fft_wisdom.h"
 #include "crossover/fir_crossover.h"
 #include "fftw3.h"
+#include "latency_histogram.h"
 #include "pcm_stream.h"
+#include "routing.h"
+#include "spsc_ring.h"
+#include "stats_shm.h"
 
 class AlsaPluginDxO : public snd_pcm_ioplug_t
 {
 public:
   enum
   {
-    kNumOutputChannels = 8,
-    kScaleS16LE = 32767,
-    kChFL = 0,
-    kChFR = 3,
-    kChRL = 1,
-    kChRR = 4,
-    kChSL = 2,
-    kChSR = 5,
-    kChLFE = 6,
-    kChUnknown = 0
+    kMaxInputChannels = 8,
+    kMaxOutputChannels = 16
   };
-  static constexpr std::array<uint32_t, 20> kMapAlsaChannel{
-      kChUnknown, kChUnknown, kChUnknown, kChFL,      kChFR,      kChRL,     kChRR,
-      kChUnknown, kChLFE,     kChSL,      kChSR,      kChUnknown, kChSL,     kChSR,
-      kChSL,      kChSR,      kChUnknown, kChUnknown, kChUnknown, kChUnknown};
 
   AlsaPluginDxO(const std::string& path,
                 uint32_t blockSize,
                 uint32_t firDelay,
                 const std::string slavePcm,
-                const snd_pcm_ioplug_callback_t* callbacks);
+                const snd_pcm_ioplug_callback_t* callbacks,
+                FirMultiChannelCrossover::Partitioning partitioning =
+                    FirMultiChannelCrossover::Partitioning::Uniform,
+                const std::string& spectrumCachePath = "",
+                const std::string& fftWisdomPath = "",
+                bool staticSchedule = false,
+                uint32_t asyncDepth = 0,
+                snd_pcm_format_t outputFormat = SND_PCM_FORMAT_UNKNOWN,
+                const Routing& routing = Routing::getDefault(),
+                bool batchedFft = false,
+                bool zeroLatency = false);
+  ~AlsaPluginDxO();
 
   std::vector<std::vector<float>> loadFIRCoeffs(const std::string& path, float scale);
-  void enableLogging();
-  bool writePcm(const int16_t* data, const uint32_t frames);
+  std::vector<int32_t> mapOutputChannels(const std::vector<uint32_t>& positions);
+  uint32_t getNumOutputChannels() const { return channelOutputs_.size(); }
+  void enableLogging(const AsyncLogger::Config& config);
+  void configureRealtime(const ThreadConfig& config, bool lockMemory);
+  bool checkWrite(snd_pcm_sframes_t result, snd_pcm_uframes_t frames);
+
+  // safe to call from any thread while the stream runs
+  struct Stats
+  {
+    LatencyHistogram::Snapshot processTime;  // updateInputs() per block
+    LatencyHistogram::Snapshot writeTime;    // slave write per block/segment
+    uint64_t deadlineMisses;                 // blocks processed slower than blockSize/rate
+    uint64_t xruns;                          // slave underruns (-EPIPE)
+    uint64_t recoveries;                     // snd_pcm_recover calls
+  };
+
+  Stats getStats() const
+  {
+    return {processTime_.getSnapshot(),
+            writeTime_.getSnapshot(),
+            deadlineMisses_.load(std::memory_order_relaxed),
+            xruns_.load(std::memory_order_relaxed),
+            recoveries_.load(std::memory_order_relaxed)};
+  }
+  void printStats();
+
+  // publishes the stats to /dev/shm/<name> every period from a thread of its own => the
+  // audio thread is not involved, returns false if the block could not be created
+  bool startStatsExport(const std::string& name,
+                        std::chrono::milliseconds period = std::chrono::milliseconds(100));
+  void stopStatsExport();
+  void publishStats();
+
+  // task runs of a build with DXO_PROFILE: Chrome trace to path, summary to the log
+  void setProfileTrace(const std::string& path) { profileTrace_ = path; }
+  void writeProfile();
+
+  // store(dst, offset, frames) converts frames [offset, offset + frames) of the block into dst
+  template <typename StoreType>
+  bool writePcm(uint32_t frames, const StoreType& store)
+  {
+    if(!mmapOutput_)
+    {
+      storeOutput(store, outputAreas_.data(), 0, 0, frames);
+      return checkWrite(snd_pcm_writei(pcm_output_device_, outputBuffer_.get(), frames), frames);
+    }
+
+    // convert straight into the ring buffer of the slave, may wrap => several chunks
+    for(uint32_t written{0}; written < frames;)
+    {
+      auto avail = snd_pcm_avail_update(pcm_output_device_);
+      if(avail < 0)
+      {
+        return checkWrite(avail, frames);
+      }
+
+      if(avail == 0)
+      {
+        // full before start threshold was reached => start now, otherwise wait like writei
+        auto result = snd_pcm_state(pcm_output_device_) == SND_PCM_STATE_PREPARED
+                          ? snd_pcm_start(pcm_output_device_)
+                          : snd_pcm_wait(pcm_output_device_, 1000);
+        if(result < 0)
+        {
+          return checkWrite(result, frames);
+        }
+        continue;
+      }
+
+      const snd_pcm_channel_area_t* areas{nullptr};
+      snd_pcm_uframes_t offset{0};
+      snd_pcm_uframes_t count = frames - written;
+      if(auto result = snd_pcm_mmap_begin(pcm_output_device_, &areas, &offset, &count); result < 0)
+      {
+        return checkWrite(result, frames);
+      }
+
+      storeOutput(store, areas, offset, written, count);
+
+      auto result = snd_pcm_mmap_commit(pcm_output_device_, offset, count);
+      if(result != count)
+      {
+        return checkWrite(result < 0 ? result : written + result, frames);
+      }
+
+      written += count;
+    }
+
+    // mmap does not auto start like writei (start threshold 1)
+    if(snd_pcm_state(pcm_output_device_) == SND_PCM_STATE_PREPARED)
+    {
+      if(auto result = snd_pcm_start(pcm_output_device_); result < 0)
+      {
+        return checkWrite(result, frames);
+      }
+    }
+
+    return true;
+  }
+
+  // outputs are of full scale +-1.0f => any format is stored straight from them
+  template <typename StoreType>
+  void storeOutput(const StoreType& store,
+                   const snd_pcm_channel_area_t* areas,
+                   snd_pcm_uframes_t offset,
+                   uint32_t blockOffset,
+                   uint32_t frames)
+  {
+    const auto storeAs = [&](auto sample) {
+      PcmStream<decltype(sample)> dst(areas, offset);
+      store(dst, blockOffset, frames);
+    };
+
+    if(outputFormat_ == SND_PCM_FORMAT_S32_LE)
+    {
+      storeAs(SampleS32{});
+    }
+    else if(outputFormat_ == SND_PCM_FORMAT_S24_LE)
+    {
+      storeAs(SampleS24{});
+    }
+    else if(outputFormat_ == SND_PCM_FORMAT_S24_3LE)
+    {
+      storeAs(SampleS24Packed{});
+    }
+    else if(outputFormat_ == SND_PCM_FORMAT_FLOAT_LE)
+    {
+      storeAs(float{});
+    }
+    else
+    {
+      storeAs(int16_t{});
+    }
+  }
+
+  // asynchronous output: transfer only queues the frames, the output thread runs the
+  // crossover and writes to the slave
+  void startOutputThread();
+  // drain => the frames still queued are written out first, else they are dropped
+  void stopOutputThread(bool drain);
+  void outputThreadRun();
+  snd_pcm_uframes_t enqueue(const snd_pcm_channel_area_t* areas,
+                            snd_pcm_uframes_t offset,
+                            snd_pcm_uframes_t size);
+
+  // records are queued and written by the logger thread => safe on the audio path
+  template <typename... Args>
+  void log(LogLevel level, const Args&... args)
+  {
+    logger_.log(level, args...);
+  }
 
   template <typename... Args>
-  void print(Args... args)
+  void print(const Args&... args)
   {
-    (logging_ << ... << args) << "\n";
+    logger_.log(LogLevel::Info, args...);
+  }
+
+  // frames [blockOffset, blockOffset + frames) of the crossover outputs
+  template <typename _LambdaType>
+  void writeOutputs(uint32_t blockOffset, uint32_t frames, _LambdaType writer)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    writer(frames, [this, blockOffset](auto& dst, uint32_t offset, uint32_t frames) {
+      withChannelCount<kMaxOutputChannels>(channelOutputs_.size(), [&](auto count) {
+        constexpr uint32_t kCount = decltype(count)::value;
+        dst.template loadChannels<kCount>(frames, channelOutputs_.data(), blockOffset + offset);
+      });
+    });
+    writeTime_.record(std::chrono::high_resolution_clock::now() - start);
+    streamPos_ += frames;
   }
 
   template <typename _InputSampleType, typename _LambdaType>
-  uint32_t update(PcmStream<_InputSampleType>& src, uint32_t size, bool hasLFE, _LambdaType writer)
+  uint32_t update(PcmStream<_InputSampleType>& src, uint32_t size, uint32_t numChannels, _LambdaType writer)
   {
+    numChannels = std::min<uint32_t>(numChannels, inputs_.size());
+
     auto i{0U};
     while(i < size)
     {
       uint32_t segmentSize = std::min(size - i, blockSize_ - inputOffset_);
 
-      if(hasLFE)
-      {
-        src.extractInterleaved(
-            segmentSize, inputs_[0] + inputOffset_, inputs_[1] + inputOffset_, inputs_[2] + inputOffset_);
-      }
-      else
-      {
-        src.extractInterleaved(segmentSize, inputs_[0] + inputOffset_, inputs_[1] + inputOffset_);
+      withChannelCount<kMaxInputChannels>(numChannels, [&](auto count) {
+        src.template extractChannels<decltype(count)::value>(segmentSize, inputs_.data(), inputOffset_);
+      });
 
+      // inputs the client does not provide get the mono sum, e.g. the sub of a stereo stream
+      for(auto k{numChannels}; k < inputs_.size(); ++k)
+      {
         for(auto j{inputOffset_}; j < inputOffset_ + segmentSize; ++j)
         {
-          inputs_[2][j] = (inputs_[0][j] + inputs_[1][j]) / 2;
+          float sum{0.0f};
+          for(uint32_t c{0}; c < numChannels; ++c)
+          {
+            sum += inputs_[c][j];
+          }
+          inputs_[k][j] = sum / numChannels;
         }
       }
 
+      // zero latency => the segment is written right away, the block only feeds the FFT tail
+      const bool zeroLatency = crossover_->isZeroLatency();
+      if(zeroLatency)
+      {
+        crossover_->processHead(inputOffset_, segmentSize);
+        writeOutputs(inputOffset_, segmentSize, writer);
+      }
+
       inputOffset_ += segmentSize;
       i += segmentSize;
 
@@ -84,25 +268,19 @@ public:
       {
         auto start = std::chrono::high_resolution_clock::now();
         crossover_->updateInputs();
-        auto end = std::chrono::high_resolution_clock::now();
-
-        double time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() * 1e-9;
-        totalTime_ += time_taken;
-        ++totalBlocks_;
-
-        PcmStream<int16_t> dst(outputBuffer_.get(), kNumOutputChannels);
-        dst.loadInterleaved(blockSize_,
-                            outputs_[channelMap_[0]],
-                            outputs_[channelMap_[1]],
-                            outputs_[channelMap_[2]],
-                            outputs_[channelMap_[3]],
-                            outputs_[channelMap_[4]],  // unused
-                            outputs_[channelMap_[5]],
-                            outputs_[channelMap_[6]],
-                            outputs_[channelMap_[7]]);
-
-        writer(outputBuffer_.get(), blockSize_);
-        streamPos_ += blockSize_;
+        auto time = std::chrono::high_resolution_clock::now() - start;
+
+        processTime_.record(time);
+        auto deadline = deadline_.load(std::memory_order_relaxed);
+        if(deadline.count() > 0 && time > deadline)
+        {
+          deadlineMisses_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if(!zeroLatency)
+        {
+          writeOutputs(0, blockSize_, writer);
+        }
         inputOffset_ = 0;
       }
     }
@@ -127,16 +305,39 @@ public:
 protected:
   uint32_t blockSize_{};
   uint32_t firDelay_{};
-  std::vector<float*> inputs_{nullptr};
-  std::vector<float*> outputs_{nullptr};
+  Routing routing_;
+  std::vector<float*> inputs_;
+  std::vector<float*> outputs_;  // routes to the same output are summed by the crossover
+  std::vector<float> silence_;
+  std::vector<const float*> channelOutputs_;  // per slave channel, unrouted => silence
   uint32_t inputOffset_{0};
-  std::ofstream logging_{};
+  AsyncLogger logger_;
   std::unique_ptr<FirMultiChannelCrossover> crossover_;
   snd_pcm_t* pcm_output_device_{nullptr};
   std::string pcmName_{};
   std::atomic<uint32_t> streamPos_{0};
-  std::unique_ptr<int16_t> outputBuffer_;
-  std::array<uint32_t, 8> channelMap_{kChFL, kChFR, kChRL, kChRR, kChUnknown, kChLFE, kChSL, kChSR};
-  double totalTime_{0};
-  uint32_t totalBlocks_{0};
+  bool mmapOutput_{false};
+  snd_pcm_format_t outputFormat_{SND_PCM_FORMAT_UNKNOWN};  // unknown => best the slave takes
+  std::unique_ptr<uint8_t[]> outputBuffer_;  // only without mmap access to the slave
+  std::vector<snd_pcm_channel_area_t> outputAreas_;
+  LatencyHistogram processTime_;
+  LatencyHistogram writeTime_;
+  std::atomic<std::chrono::nanoseconds> deadline_{};  // one block at the stream rate, 0 => not prepared
+  std::atomic<uint64_t> deadlineMisses_{0};
+  std::atomic<uint64_t> xruns_{0};
+  std::atomic<uint64_t> recoveries_{0};
+  std::unique_ptr<StatsShm> statsShm_;
+  std::thread statsThread_;
+  std::binary_semaphore statsStop_{0};
+  std::string profileTrace_;  // empty => no trace written
+  uint32_t asyncDepth_{0};  // frames queued for the output thread, 0 => synchronous
+  uint32_t frameBytes_{0};
+  std::unique_ptr<SpscRing<uint8_t>> ring_;
+  std::thread outputThread_;
+  std::atomic<bool> outputStop_{false};
+  std::atomic<bool> outputDrain_{false};
+  std::atomic<uint32_t> dataEpoch_{0};   // bumped after enqueue => wakes the output thread
+  std::atomic<uint32_t> spaceEpoch_{0};  // bumped after consume => wakes a full transfer
+  std::atomic<uint32_t> acceptedFrames_{0};
+  ThreadConfig outputThreadConfig_;
 };
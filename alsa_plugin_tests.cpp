@@ -55,14 +55,24 @@ TEST_F(AlsaPluginTest, Test_PluginUpdate)
   }
   PcmStream<float> stream(interleaved.data(), 0);
 
-  const auto test_writer = [&interleaved](const int16_t* data, uint32_t frames) {
+  const auto test_writer = [this, &interleaved](uint32_t frames, const auto& store) {
     ASSERT_EQ(frames, kFrames);
+
+    // converted in two chunks like a wrapping slave buffer
+    std::vector<int16_t> buffer(frames * plugin.getNumOutputChannels());
+    PcmStream<int16_t> first(buffer.data(), plugin.getNumOutputChannels());
+    store(first, 0, 100);
+    PcmStream<int16_t> second(buffer.data() + 100 * plugin.getNumOutputChannels(),
+                              plugin.getNumOutputChannels());
+    store(second, 100, frames - 100);
+
+    auto data = buffer.data();
     auto ch0 = interleaved.data()[0].getData(0, frames);
     auto ch1 = interleaved.data()[1].getData(0, frames);
 
     for(auto i{0}; i < kFrames; ++i)
     {
-      auto index = i * AlsaPluginDxO::kNumOutputChannels;
+      auto index = i * plugin.getNumOutputChannels();
       EXPECT_NEAR(data[index + 0], ch0[i] * 32768.0f, 1.1f);
       EXPECT_NEAR(data[index + 1], ch1[i] * 32768.0f, 1.1f);
       EXPECT_NEAR(data[index + 2], ch0[i] * 32768.0f, 1.1f);
@@ -73,5 +83,76 @@ TEST_F(AlsaPluginTest, Test_PluginUpdate)
     }
   };
 
-  plugin.update(stream, kFrames, false, test_writer);
+  plugin.update(stream, kFrames, 2, test_writer);
+}
+
+TEST_F(AlsaPluginTest, Test_PluginUpdateS32)
+{
+  static constexpr auto kFrames = 256;
+  auto interleaved = GetInterleavedData<float>(2);
+  for(auto i{0}; i < kFrames; ++i)
+  {
+    interleaved[0].setData(i, {0.5f / static_cast<float>(i + 1)});
+    interleaved[1].setData(i, {-0.5f / static_cast<float>(i + 1)});
+  }
+  PcmStream<float> stream(interleaved.data(), 0);
+
+  // same outputs as for S16_LE, only the store scales differently
+  const auto test_writer = [this, &interleaved](uint32_t frames, const auto& store) {
+    std::vector<SampleS32> buffer(frames * plugin.getNumOutputChannels());
+    PcmStream<SampleS32> dst(buffer.data(), plugin.getNumOutputChannels());
+    store(dst, 0, frames);
+
+    auto ch0 = interleaved.data()[0].getData(0, frames);
+    auto ch1 = interleaved.data()[1].getData(0, frames);
+
+    for(auto i{0}; i < kFrames; ++i)
+    {
+      auto index = i * plugin.getNumOutputChannels();
+      EXPECT_NEAR(buffer[index + 0].value, ch0[i] * 2147483648.0f, 1.1f * 65536);
+      EXPECT_NEAR(buffer[index + 1].value, ch1[i] * 2147483648.0f, 1.1f * 65536);
+      EXPECT_NEAR(buffer[index + 5].value, 0.0f, 1.1f * 65536);
+    }
+  };
+
+  plugin.update(stream, kFrames, 2, test_writer);
+}
+
+TEST_F(AlsaPluginTest, Test_StatsExport)
+{
+  static constexpr auto kFrames = 256;
+
+  // task times are collected from the start of the export on
+  ASSERT_TRUE(plugin.startStatsExport("dxo_plugin_test", std::chrono::milliseconds(10)));
+
+  auto interleaved = GetInterleavedData<float>(2);
+  PcmStream<float> stream(interleaved.data(), 0);
+  plugin.update(stream, kFrames, 2, [this](uint32_t frames, const auto& store) {
+    std::vector<int16_t> buffer(frames * plugin.getNumOutputChannels());
+    PcmStream<int16_t> dst(buffer.data(), plugin.getNumOutputChannels());
+    store(dst, 0, frames);
+  });
+  sleepFor(50);
+
+  auto shm = StatsShm::attach("dxo_plugin_test");
+  ASSERT_NE(shm, nullptr);
+
+  DxoStats stats;
+  ASSERT_TRUE(shm->read(stats));
+  EXPECT_EQ(stats.pid, getpid());
+  EXPECT_EQ(stats.blockSize, 256);
+  EXPECT_EQ(stats.processTime.count, 1);
+  EXPECT_EQ(stats.writeTime.count, 1);
+  EXPECT_GT(stats.numWorkers, 0);
+
+  ASSERT_GT(stats.numTasks, 0);
+  auto ifft = std::find_if(stats.tasks.begin(), stats.tasks.begin() + stats.numTasks, [](auto& task) {
+    return std::string(task.label) == "ifft";
+  });
+  ASSERT_NE(ifft, stats.tasks.begin() + stats.numTasks);
+  EXPECT_GT(ifft->count, 0);
+  EXPECT_GE(ifft->totalNs, ifft->maxNs);
+
+  plugin.stopStatsExport();
+  EXPECT_EQ(StatsShm::attach("dxo_plugin_test"), nullptr);
 }
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <semaphore>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "tasks/mpmc_queue.h"
+
+enum class LogLevel : uint8_t
+{
+  Error,
+  Warning,
+  Info,
+  Debug
+};
+
+// Logger for realtime threads: log() copies its arguments into a pre-allocated record, a
+// background thread formats the records and does the file I/O.
+//
+// Records cycle through two lock-free queues (free => pending => free), so log() neither
+// allocates nor blocks nor calls into the kernel. Records that find no free slot or exceed
+// the rate limit are dropped and reported by the next line written.
+//
+// Arguments are streamed like into an ostream: strings (literals too, an array does not tell
+// a literal from a stack buffer) are copied and truncated to what fits into the record,
+// numbers are stored binary.
+class AsyncLogger
+{
+public:
+  struct Config
+  {
+    std::string path;  // empty => logging disabled
+    LogLevel level{LogLevel::Info};
+    uint32_t rateLimit{100};        // records per second, 0 => unlimited
+    uint64_t maxFileSize{1 << 20};  // bytes before the file is rotated, 0 => never
+    uint32_t numFiles{2};           // rotated files kept next to path: path.1 ... path.<numFiles>
+  };
+
+  AsyncLogger() : records_(kNumRecords)
+  {
+    for(auto& record : records_)
+    {
+      free_.push(&record);
+    }
+  }
+
+  AsyncLogger(const AsyncLogger&) = delete;
+  AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+  ~AsyncLogger() { close(); }
+
+  static LogLevel parseLevel(const std::string& str)
+  {
+    static constexpr const char* kNames[] = {"error", "warning", "info", "debug"};
+    for(uint32_t i{0}; i < std::size(kNames); ++i)
+    {
+      if(str == kNames[i])
+      {
+        return static_cast<LogLevel>(i);
+      }
+    }
+
+    throw std::invalid_argument("Error: unknown log level " + str);
+  }
+
+  // returns false if the file can not be opened
+  bool open(const Config& config, std::chrono::milliseconds period = std::chrono::milliseconds(50))
+  {
+    close();
+
+    config_ = config;
+    if(config_.path.length() == 0)
+    {
+      return true;
+    }
+
+    file_.open(config_.path, std::ios::app | std::ios::out);
+    if(!file_)
+    {
+      return false;
+    }
+
+    level_.store(config_.level, std::memory_order_relaxed);
+    enabled_.store(true, std::memory_order_release);
+    thread_ = std::thread([this, period] {
+      // may be spawned by a realtime thread => file I/O must not compete with the audio
+      sched_param param{};
+      pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+      while(!stop_.try_acquire_for(period))
+      {
+        flush();
+      }
+      flush();
+    });
+
+    return true;
+  }
+
+  // writes what is pending
+  void close()
+  {
+    enabled_.store(false, std::memory_order_release);
+
+    if(thread_.joinable())
+    {
+      stop_.release();
+      thread_.join();
+    }
+
+    file_.close();
+  }
+
+  bool isEnabled(LogLevel level) const
+  {
+    return enabled_.load(std::memory_order_acquire) && level <= level_.load(std::memory_order_relaxed);
+  }
+
+  // any thread, wait free apart from the queue CAS
+  template <typename... Args>
+  void log(LogLevel level, const Args&... args)
+  {
+    static_assert(sizeof...(Args) <= kMaxArgs, "too many log arguments");
+
+    if(!isEnabled(level) || !acquireRate())
+    {
+      return;
+    }
+
+    auto record = free_.pop();
+    if(record == nullptr)
+    {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    record->time = std::chrono::system_clock::now();
+    record->level = level;
+    record->numArgs = 0;
+    record->textSize = 0;
+    (record->add(args), ...);
+
+    pending_.push(record);
+  }
+
+  // records dropped so far (queue full or rate limit)
+  uint64_t getDropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+protected:
+  static constexpr uint32_t kNumRecords = 256;
+  static constexpr uint32_t kMaxArgs = 12;
+  static constexpr uint32_t kTextSize = 256;
+
+  struct Arg
+  {
+    enum Type : uint8_t
+    {
+      Text,
+      Signed,
+      Unsigned,
+      Double
+    };
+
+    Type type;
+    union
+    {
+      int64_t i;
+      uint64_t u;
+      double d;
+      struct
+      {
+        uint16_t offset;
+        uint16_t size;
+      } text;
+    };
+  };
+
+  struct Record
+  {
+    std::chrono::system_clock::time_point time;
+    LogLevel level;
+    uint8_t numArgs;
+    uint16_t textSize;
+    Arg args[kMaxArgs];
+    char text[kTextSize];
+
+    // up to the first zero, a buffer need not be terminated
+    template <size_t N>
+    void add(const char (&str)[N])
+    {
+      addText(str, strnlen(str, N));
+    }
+
+    template <typename T>
+      requires std::is_convertible_v<T, const char*>
+    void add(T str)
+    {
+      addText(str, str ? std::strlen(str) : 0);
+    }
+
+    void add(const std::string& str) { addText(str.data(), str.size()); }
+
+    template <typename T>
+      requires std::is_arithmetic_v<T> || std::is_enum_v<T>
+    void add(T value)
+    {
+      if constexpr(std::is_floating_point_v<T>)
+      {
+        args[numArgs++] = {Arg::Double, {.d = value}};
+      }
+      else if constexpr(std::is_enum_v<T> || std::is_signed_v<T>)
+      {
+        args[numArgs++] = {Arg::Signed, {.i = static_cast<int64_t>(value)}};
+      }
+      else
+      {
+        args[numArgs++] = {Arg::Unsigned, {.u = static_cast<uint64_t>(value)}};
+      }
+    }
+
+    void addText(const char* str, size_t size)
+    {
+      size = std::min<size_t>(size, kTextSize - textSize);
+      std::memcpy(text + textSize, str, size);
+
+      args[numArgs++] = {Arg::Text, {.text = {textSize, static_cast<uint16_t>(size)}}};
+      textSize += size;
+    }
+  };
+
+  // fixed window of one second, a burst of errors is cut off instead of flooding the file
+  bool acquireRate()
+  {
+    if(config_.rateLimit == 0)
+    {
+      return true;
+    }
+
+    auto second = std::chrono::duration_cast<std::chrono::seconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+    auto window = window_.load(std::memory_order_relaxed);
+    if(window != second && window_.compare_exchange_strong(window, second, std::memory_order_relaxed))
+    {
+      windowCount_.store(0, std::memory_order_relaxed);
+    }
+
+    if(windowCount_.fetch_add(1, std::memory_order_relaxed) >= config_.rateLimit)
+    {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    return true;
+  }
+
+  // background thread only
+  void flush()
+  {
+    auto record = pending_.pop();
+    if(record == nullptr)
+    {
+      return;
+    }
+
+    // before writing => the latest lines are always in path
+    rotate();
+
+    for(; record != nullptr; record = pending_.pop())
+    {
+      auto dropped = dropped_.load(std::memory_order_relaxed);
+      if(dropped != reportedDropped_)
+      {
+        writePrefix(record->time, LogLevel::Warning);
+        file_ << (dropped - reportedDropped_) << " log messages dropped\n";
+        reportedDropped_ = dropped;
+      }
+
+      write(*record);
+      free_.push(record);
+    }
+
+    file_.flush();
+  }
+
+  void writePrefix(std::chrono::system_clock::time_point time, LogLevel level)
+  {
+    static constexpr char kLevels[] = {'E', 'W', 'I', 'D'};
+
+    auto seconds = std::chrono::system_clock::to_time_t(time);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count() % 1000;
+
+    std::tm local{};
+    localtime_r(&seconds, &local);
+    file_ << std::put_time(&local, "%F %T") << '.' << std::setfill('0') << std::setw(3) << ms
+          << std::setfill(' ') << ' ' << kLevels[static_cast<uint32_t>(level)] << ' ';
+  }
+
+  void write(const Record& record)
+  {
+    writePrefix(record.time, record.level);
+
+    for(uint32_t i{0}; i < record.numArgs; ++i)
+    {
+      auto& arg = record.args[i];
+      switch(arg.type)
+      {
+        case Arg::Text:
+          file_.write(record.text + arg.text.offset, arg.text.size);
+          break;
+        case Arg::Signed:
+          file_ << arg.i;
+          break;
+        case Arg::Unsigned:
+          file_ << arg.u;
+          break;
+        case Arg::Double:
+          file_ << arg.d;
+          break;
+      }
+    }
+
+    file_ << '\n';
+  }
+
+  // path => path.1 => ... => path.<numFiles>, the oldest is removed
+  void rotate()
+  {
+    auto size = file_.tellp();
+    if(config_.maxFileSize == 0 || size < 0 || static_cast<uint64_t>(size) < config_.maxFileSize)
+    {
+      return;
+    }
+
+    file_.close();
+
+    std::error_code error;
+    auto rotated = [this](uint32_t i) { return config_.path + "." + std::to_string(i); };
+    std::filesystem::remove(rotated(config_.numFiles), error);
+    for(uint32_t i{config_.numFiles}; i > 1; --i)
+    {
+      std::filesystem::rename(rotated(i - 1), rotated(i), error);
+    }
+
+    if(config_.numFiles > 0)
+    {
+      std::filesystem::rename(config_.path, rotated(1), error);
+    }
+    else
+    {
+      std::filesystem::remove(config_.path, error);
+    }
+
+    file_.open(config_.path, std::ios::app | std::ios::out);
+  }
+
+  Config config_;
+  std::atomic<bool> enabled_{false};
+  std::atomic<LogLevel> level_{LogLevel::Info};
+  std::vector<Record> records_;
+  MpmcQueue<Record*> free_{kNumRecords};
+  MpmcQueue<Record*> pending_{kNumRecords};
+  std::atomic<uint64_t> dropped_{0};
+  uint64_t reportedDropped_{0};  // background thread only
+  std::atomic<int64_t> window_{0};
+  std::atomic<uint32_t> windowCount_{0};
+  std::ofstream file_;
+  std::thread thread_;
+  std::binary_semaphore stop_{0};
+};
@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "async_logger.h"
+
+class AsyncLoggerTest : public testing::Test
+{
+protected:
+  void TearDown() override
+  {
+    for(auto& file : {path_, path_ + ".1", path_ + ".2", path_ + ".3"})
+    {
+      std::remove(file.c_str());
+    }
+  }
+
+  std::vector<std::string> readLines(const std::string& path)
+  {
+    std::vector<std::string> lines;
+    std::ifstream file(path);
+    for(std::string line; std::getline(file, line);)
+    {
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
+  std::string path_{"async_logger_test.txt"};
+};
+
+TEST_F(AsyncLoggerTest, Test_Format)
+{
+  AsyncLogger logger;
+  ASSERT_TRUE(logger.open({path_, LogLevel::Info, 0}));
+
+  std::string dynamic{"dynamic"};
+  char buffer[] = "not a literal";
+  const char* error = buffer;
+  char stack[32];
+  std::snprintf(stack, sizeof(stack), "stack %d", 7);
+
+  logger.log(LogLevel::Error, "write error [", error, "] ", -32, "/", 256U, " ", 1.5, " ", dynamic);
+  logger.log(LogLevel::Debug, "filtered");
+  logger.log(LogLevel::Info, "text ", std::string(300, 'x'));
+  logger.log(LogLevel::Warning, stack, " buffer");
+
+  // copied at log time, not when the logger thread writes
+  buffer[0] = 'N';
+  std::snprintf(stack, sizeof(stack), "overwritten");
+  logger.close();
+
+  auto lines = readLines(path_);
+  ASSERT_EQ(lines.size(), 3);
+
+  // "YYYY-MM-DD HH:MM:SS.mmm E ..."
+  EXPECT_EQ(lines[0].substr(24), "E write error [not a literal] -32/256 1.5 dynamic");
+  EXPECT_EQ(lines[1].substr(24, 7), "I text ");
+  EXPECT_LT(lines[1].size(), 24 + 7 + 300);
+  EXPECT_EQ(lines[2].substr(24), "W stack 7 buffer");
+}
+
+TEST_F(AsyncLoggerTest, Test_Disabled)
+{
+  AsyncLogger logger;
+  EXPECT_FALSE(logger.isEnabled(LogLevel::Error));
+  logger.log(LogLevel::Error, "nowhere");
+
+  ASSERT_TRUE(logger.open({}));
+  EXPECT_FALSE(logger.isEnabled(LogLevel::Error));
+
+  EXPECT_EQ(AsyncLogger::parseLevel("warning"), LogLevel::Warning);
+  EXPECT_THROW(AsyncLogger::parseLevel("verbose"), std::invalid_argument);
+}
+
+TEST_F(AsyncLoggerTest, Test_RateLimit)
+{
+  AsyncLogger logger;
+  ASSERT_TRUE(logger.open({path_, LogLevel::Info, 10}));
+
+  for(uint32_t i{0}; i < 100; ++i)
+  {
+    logger.log(LogLevel::Error, "incomplete write ", i);
+  }
+  EXPECT_GE(logger.getDropped(), 80);
+
+  // next window => accepted again, the drops are reported in between
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  logger.log(LogLevel::Info, "after burst");
+  logger.close();
+
+  auto lines = readLines(path_);
+  ASSERT_GE(lines.size(), 3);
+  EXPECT_EQ(std::count_if(lines.begin(), lines.end(), [](auto& line) {
+              return line.find("log messages dropped") != std::string::npos;
+            }),
+            1);
+  EXPECT_NE(lines.back().find("after burst"), std::string::npos);
+}
+
+TEST_F(AsyncLoggerTest, Test_Rotate)
+{
+  AsyncLogger logger;
+  ASSERT_TRUE(logger.open({path_, LogLevel::Info, 0, 256, 2}, std::chrono::milliseconds(1)));
+
+  for(uint32_t i{0}; i < 40; ++i)
+  {
+    logger.log(LogLevel::Info, "line ", i);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  logger.close();
+
+  EXPECT_TRUE(std::filesystem::exists(path_ + ".1"));
+  EXPECT_TRUE(std::filesystem::exists(path_ + ".2"));
+  EXPECT_FALSE(std::filesystem::exists(path_ + ".3"));
+  EXPECT_NE(readLines(path_).back().find("line 39"), std::string::npos);
+}
+
+TEST_F(AsyncLoggerTest, Test_ConcurrentProducers)
+{
+  AsyncLogger logger;
+  ASSERT_TRUE(logger.open({path_, LogLevel::Info, 0}, std::chrono::milliseconds(1)));
+
+  std::vector<std::thread> producers;
+  for(uint32_t t{0}; t < 4; ++t)
+  {
+    producers.emplace_back([&logger, t] {
+      for(uint32_t i{0}; i < 1000; ++i)
+      {
+        logger.log(LogLevel::Info, "thread ", t, " line ", i);
+      }
+    });
+  }
+  for(auto& producer : producers)
+  {
+    producer.join();
+  }
+  logger.close();
+
+  // full ring drops, never corrupts
+  auto lines = readLines(path_);
+  uint64_t written{0};
+  for(auto& line : lines)
+  {
+    if(line.find("log messages dropped") == std::string::npos)
+    {
+      EXPECT_EQ(line.substr(24, 9), "I thread ");
+      ++written;
+    }
+  }
+  EXPECT_EQ(written + logger.getDropped(), 4000);
+}
@@ -0,0 +1,226 @@
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "convolution.h"
+#include "fir_crossover.h"
+
+// combine stage: H0 * X + partial sum of all other partitions
+static void BM_MultiplyAccumulate(benchmark::State& state)
+{
+  const uint32_t blockSize = state.range(0);
+  const uint32_t size = getSpectrumSize(2 * blockSize);
+
+  SpectrumVec h(size, 0.5f);
+  SpectrumVec x(size, 2.0f);
+  SpectrumVec sum(size, 0.1f);
+  SpectrumVec result(size);
+
+  for(auto _ : state)
+  {
+    multiplyAccumulate(result.data(), h.data(), x.data(), sum.data(), size);
+    benchmark::DoNotOptimize(result.data());
+    benchmark::ClobberMemory();
+  }
+
+  state.SetComplexityN(blockSize);
+}
+
+BENCHMARK(BM_MultiplyAccumulate)->RangeMultiplier(2)->Range(32, 4096)->Complexity(benchmark::oN);
+
+#ifdef BUILD_X86
+// spectral MAC per kernel set, compare against BM_ForwardFFT of the same block size
+template <const x86::Kernels& kernels>
+static void BM_MultiplyAddX86(benchmark::State& state)
+{
+  const uint32_t blockSize = state.range(0);
+  const uint32_t size = getSpectrumSize(2 * blockSize);
+
+  SpectrumVec h(size, 0.5f);
+  SpectrumVec x(size, 2.0f);
+  SpectrumVec result(size);
+
+  for(auto _ : state)
+  {
+    kernels.multiplyAdd(result.data(), h.data(), x.data(), size / 2);
+    benchmark::DoNotOptimize(result.data());
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations() * size / 2);
+}
+
+// the avx2 variant is registered by main() on cpus that have it
+BENCHMARK(BM_MultiplyAddX86<x86::kSse2Kernels>)->RangeMultiplier(4)->Range(32, 2048);
+#endif
+
+static void BM_ForwardFFT(benchmark::State& state)
+{
+  const uint32_t blockSize = state.range(0);
+  ForwardFFT fft{2 * blockSize};
+  std::fill(fft.input_.begin(), fft.input_.end(), 0.5f);
+
+  for(auto _ : state)
+  {
+    fft.run();
+    benchmark::DoNotOptimize(fft.output_.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * fft.output_.size() / 2);
+}
+
+BENCHMARK(BM_ForwardFFT)->RangeMultiplier(4)->Range(32, 2048);
+
+// zero latency head: blockSize taps on a sub-block of 32 frames
+static void BM_DirectFir(benchmark::State& state)
+{
+  const uint32_t numTaps = state.range(0);
+  constexpr uint32_t kFrames = 32;
+
+  std::vector<float> h(numTaps, 0.001f);
+  std::vector<float> x(numTaps + kFrames, 0.5f);
+  std::vector<float> result(kFrames);
+
+  for(auto _ : state)
+  {
+    fir(result.data(), h.data(), x.data() + numTaps, numTaps, kFrames);
+    benchmark::DoNotOptimize(result.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * kFrames);
+}
+
+BENCHMARK(BM_DirectFir)->Arg(64)->Arg(128)->Arg(256);
+
+// one filter of numTaps on a single thread: forward FFT, MACs over all partitions, inverse FFT
+static void BM_Convolution(benchmark::State& state)
+{
+  const uint32_t blockSize = state.range(0);
+  const uint32_t numTaps = state.range(1);
+
+  std::vector<float> h(numTaps, 0.001f);
+  Convolution filter(h, blockSize);
+  auto [inputJob, input] = Convolution::getInputTask(blockSize);
+  auto [rootJobs, output] = filter.getOutputTasks(inputJob);
+
+  TaskRunner runner(1);
+  runner.run(rootJobs, false);
+
+  for(auto _ : state)
+  {
+    std::fill(input.begin(), input.end(), 0.5f);
+    runner.run({inputJob});
+    benchmark::DoNotOptimize(output.data());
+    runner.run(rootJobs, false);
+  }
+
+  // drain the background run before the graph goes away
+  runner.run({inputJob});
+
+  state.SetItemsProcessed(state.iterations() * blockSize);
+  state.counters["partitions"] = (numTaps + blockSize - 1) / blockSize;
+}
+
+BENCHMARK(BM_Convolution)->ArgsProduct({{64, 128, 256, 512}, {1024, 4096, 16384, 65536}})->UseRealTime();
+
+// one audio block through the whole task graph, 7 filters of 4096 taps on 3 inputs like coeffs.m
+static void BM_CrossoverUpdate(benchmark::State& state)
+{
+  const uint32_t blockSize = state.range(0);
+  const uint32_t numThreads = state.range(1);
+  const bool staticSchedule = state.range(2) != 0;
+  const bool batchedFft = state.range(3) != 0;
+
+  std::vector<float> h(4096, 0.001f);
+  std::vector<FirMultiChannelCrossover::ConfigType> config{
+      {0, h}, {0, h}, {0, h}, {1, h}, {1, h}, {1, h}, {2, h}};
+
+  FirMultiChannelCrossover fmcc(blockSize, 3, config, numThreads, nullptr, batchedFft);
+
+  if(staticSchedule)
+  {
+    fmcc.compileSchedule();
+  }
+
+  for(auto _ : state)
+  {
+    fmcc.updateInputs();
+    benchmark::DoNotOptimize(fmcc.getOutputBuffer(0).data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * blockSize);
+}
+
+BENCHMARK(BM_CrossoverUpdate)->ArgsProduct({{64, 128, 256}, {1, 2, 3, 4}, {0, 1}, {0, 1}})->UseRealTime();
+
+// L + R summed into a mono sub: per block one inverse FFT instead of one per filter plus an
+// adder, kSummed = false keeps two outputs for comparison
+template <bool kSummed>
+static void BM_CrossoverSummedOutput(benchmark::State& state)
+{
+  const uint32_t blockSize = state.range(0);
+
+  std::vector<float> h(4096, 0.001f);
+  std::vector<FirMultiChannelCrossover::ConfigType> config{
+      {0, h, FirMultiChannelCrossover::Partitioning::Uniform, 0},
+      {1, h, FirMultiChannelCrossover::Partitioning::Uniform, kSummed ? 0U : 1U}};
+
+  FirMultiChannelCrossover fmcc(blockSize, 2, config, 1);
+
+  std::vector<float> output(blockSize);
+  for(auto _ : state)
+  {
+    fmcc.updateInputs();
+
+    auto a = fmcc.getOutputBuffer(0);
+    if constexpr(kSummed)
+    {
+      std::copy(a.begin(), a.end(), output.begin());
+    }
+    else
+    {
+      auto b = fmcc.getOutputBuffer(1);
+      std::transform(a.begin(), a.end(), b.begin(), output.begin(), std::plus<float>());
+    }
+    benchmark::DoNotOptimize(output.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * blockSize);
+}
+
+BENCHMARK(BM_CrossoverSummedOutput<false>)->Arg(64)->Arg(256)->UseRealTime();
+BENCHMARK(BM_CrossoverSummedOutput<true>)->Arg(64)->Arg(256)->UseRealTime();
+
+// --benchmark_out=<file> --benchmark_out_format=json (see the BenchmarkJson target) writes
+// the results with this context, so runs of other releases and cpus can be told apart
+int main(int argc, char** argv)
+{
+  benchmark::AddCustomContext("dxo_version", DXO_VERSION);
+#if defined(BUILD_X86)
+  benchmark::AddCustomContext("kernels", x86::hasAvx2() ? "avx2" : "sse2");
+  if(x86::hasAvx2())
+  {
+    benchmark::RegisterBenchmark("BM_MultiplyAddX86<x86::kAvx2Kernels>",
+                                 BM_MultiplyAddX86<x86::kAvx2Kernels>)
+        ->RangeMultiplier(4)
+        ->Range(32, 2048);
+  }
+#elif defined(BUILD_ARM)
+  benchmark::AddCustomContext("kernels", "neon");
+#else
+  benchmark::AddCustomContext("kernels", "generic");
+#endif
+
+  benchmark::Initialize(&argc, argv);
+  if(benchmark::ReportUnrecognizedArguments(argc, argv))
+  {
+    return 1;
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -3,8 +3,8 @@
 #include <stdint.h>
 
 #include <algorithm>
+#include <cassert>
 #include <cmath>
-#include <complex>
 #include <cstring>
 #include <list>
 #include <span>
@@ -12,145 +12,138 @@
 
 #include "../tasks/tasks.h"
 #include "fft.h"
+#include "frequency_delay_line.h"
+#include "spectrum_cache.h"
 
 #ifdef BUILD_ARM
 #include "neon.h"
 #endif
 
-using ComplexVec = std::vector<std::complex<float>>;
+#ifdef BUILD_X86
+#include "x86.h"
+#endif
+
 using RealVec = std::vector<float>;
 using TaskType = std::shared_ptr<Task>;
 
-static_assert(sizeof(std::complex<float>) == sizeof(fftwf_complex));
+// All kernels work on padded split complex spectra of size floats (see getSpectrumSize), real
+// parts in the first half, imaginary parts in the second half. size / 2 is a multiple of
+// kSpectrumAlignment and all pointers are cache line aligned.
 
-inline void multiply(std::complex<float>* result,
-                     const std::complex<float>* src1,
-                     const std::complex<float>* src2,
+inline void multiply(float* __restrict result,
+                     const float* __restrict src1,
+                     const float* __restrict src2,
                      uint32_t size)
 {
-  auto s1 = src1;
-  auto s2 = src2;
-  auto r = result;
-  auto rend = result + size;
+  const auto half = size / 2;
 
-  if((size & 1) && ((size - 1) % 8) == 0)
+#if defined(BUILD_X86)
+  x86::getKernels().multiply(result, src1, src2, half);
+#elif defined(BUILD_ARM)
+  for(uint32_t i{0}; i < half; i += 4)
   {
-    --rend;
-    while(r < rend)
-    {
-#ifdef BUILD_ARM
-      neon::multiply(r, s1, s2);
-      neon::multiply(r + 4, s1 + 4, s2 + 4);
+    neon::multiply(result + i, src1 + i, src2 + i, half);
+  }
 #else
-      r[0] = s1[0] * s2[0];
-      r[1] = s1[1] * s2[1];
-      r[2] = s1[2] * s2[2];
-      r[3] = s1[3] * s2[3];
-      r[4] = s1[4] * s2[4];
-      r[5] = s1[5] * s2[5];
-      r[6] = s1[6] * s2[6];
-      r[7] = s1[7] * s2[7];
+  for(uint32_t i{0}; i < half; ++i)
+  {
+    result[i] = src1[i] * src2[i] - src1[i + half] * src2[i + half];
+    result[i + half] = src1[i] * src2[i + half] + src1[i + half] * src2[i];
+  }
 #endif
-      s1 += 8;
-      s2 += 8;
-      r += 8;
-    }
+}
+
+inline void multiplyAdd(float* __restrict result,
+                        const float* __restrict src1,
+                        const float* __restrict src2,
+                        uint32_t size)
+{
+  const auto half = size / 2;
 
-    r[0] = s1[0] * s2[0];
+#if defined(BUILD_X86)
+  x86::getKernels().multiplyAdd(result, src1, src2, half);
+#elif defined(BUILD_ARM)
+  for(uint32_t i{0}; i < half; i += 4)
+  {
+    neon::multiplyAdd(result + i, src1 + i, src2 + i, half);
   }
-  else
+#else
+  for(uint32_t i{0}; i < half; ++i)
   {
-    while(r < rend)
-    {
-      *r++ = *s1++ * *s2++;
-    }
+    result[i] += src1[i] * src2[i] - src1[i + half] * src2[i + half];
+    result[i + half] += src1[i] * src2[i + half] + src1[i + half] * src2[i];
   }
+#endif
 }
 
-inline void multiplyAdd(std::complex<float>* result,
-                        const std::complex<float>* src1,
-                        const std::complex<float>* src2,
-                        uint32_t size)
+// result = src1 * src2 + sum in a single pass
+inline void multiplyAccumulate(float* __restrict result,
+                               const float* __restrict src1,
+                               const float* __restrict src2,
+                               const float* __restrict sum,
+                               uint32_t size)
 {
-  auto s1 = src1;
-  auto s2 = src2;
-  auto r = result;
-  auto rend = result + size;
+  const auto half = size / 2;
 
-  if((size & 1) && ((size - 1) % 8) == 0)
+#if defined(BUILD_X86)
+  x86::getKernels().multiplyAccumulate(result, src1, src2, sum, half);
+#elif defined(BUILD_ARM)
+  for(uint32_t i{0}; i < half; i += 4)
   {
-    --rend;
-    while(r < rend)
-    {
-#ifdef BUILD_ARM
-      neon::multiplyAdd(r, s1, s2);
-      neon::multiplyAdd(r + 4, s1 + 4, s2 + 4);
+    neon::multiplyAccumulate(result + i, src1 + i, src2 + i, sum + i, half);
+  }
 #else
-      r[0] += s1[0] * s2[0];
-      r[1] += s1[1] * s2[1];
-      r[2] += s1[2] * s2[2];
-      r[3] += s1[3] * s2[3];
-      r[4] += s1[4] * s2[4];
-      r[5] += s1[5] * s2[5];
-      r[6] += s1[6] * s2[6];
-      r[7] += s1[7] * s2[7];
+  for(uint32_t i{0}; i < half; ++i)
+  {
+    result[i] = sum[i] + src1[i] * src2[i] - src1[i + half] * src2[i + half];
+    result[i + half] = sum[i + half] + src1[i] * src2[i + half] + src1[i + half] * src2[i];
+  }
 #endif
-      s1 += 8;
-      s2 += 8;
-      r += 8;
-    }
+}
 
-    r[0] += s1[0] * s2[0];
+// result may be the same as src1
+inline void add(float* result, const float* src1, const float* src2, uint32_t size)
+{
+#if defined(BUILD_X86)
+  x86::getKernels().add(result, src1, src2, size);
+#elif defined(BUILD_ARM)
+  for(uint32_t i{0}; i < size; i += 4)
+  {
+    neon::add(result + i, src1 + i, src2 + i);
   }
-  else
+#else
+  for(uint32_t i{0}; i < size; ++i)
   {
-    while(r < rend)
-    {
-      *r++ += *s1++ * *s2++;
-    }
+    result[i] = src1[i] + src2[i];
   }
+#endif
 }
 
-inline void add(std::complex<float>* result,
-                const std::complex<float>* src1,
-                const std::complex<float>* src2,
-                uint32_t size)
+// time domain FIR on plain sample arrays (not spectra): result[i] += sum of h[m] * x[i - m]
+// over m < numTaps, x holds numTaps - 1 samples of history before x[0]
+inline void fir(float* __restrict result,
+                const float* __restrict h,
+                const float* __restrict x,
+                uint32_t numTaps,
+                uint32_t frames)
 {
-  auto s1 = src1;
-  auto s2 = src2;
-  auto r = result;
-  auto rend = result + size;
+  uint32_t i{0};
 
-  if((size & 1) && ((size - 1) % 8) == 0)
+#if defined(BUILD_X86)
+  x86::getKernels().fir(result, h, x, numTaps, frames);
+  i = frames;
+#elif defined(BUILD_ARM)
+  for(; i + 4 <= frames; i += 4)
   {
-    --rend;
-    while(r < rend)
-    {
-#ifdef BUILD_ARM
-      neon::add(r, s1, s2);
-      neon::add(r + 4, s1 + 4, s2 + 4);
-#else
-      r[0] = s1[0] + s2[0];
-      r[1] = s1[1] + s2[1];
-      r[2] = s1[2] + s2[2];
-      r[3] = s1[3] + s2[3];
-      r[4] = s1[4] + s2[4];
-      r[5] = s1[5] + s2[5];
-      r[6] = s1[6] + s2[6];
-      r[7] = s1[7] + s2[7];
+    neon::fir(result + i, h, x + i, numTaps);
+  }
 #endif
-      s1 += 8;
-      s2 += 8;
-      r += 8;
-    }
 
-    r[0] = s1[0] + s2[0];
-  }
-  else
+  for(; i < frames; ++i)
   {
-    while(r < rend)
+    for(uint32_t m{0}; m < numTaps; ++m)
     {
-      *r++ = *s1++ + *s2++;
+      result[i] += h[m] * *(x + i - m);
     }
   }
 }
@@ -158,24 +151,37 @@ inline void add(std::complex<float>* result,
 class Convolution
 {
 public:
-  Convolution(const std::span<const float>& h, uint32_t inputBlockSize)
+  Convolution(const std::span<const float>& h, uint32_t inputBlockSize, SpectrumCache* cache = nullptr)
       : subFilterSize_{inputBlockSize}, fftSize_{inputBlockSize + subFilterSize_}, inverseFft_{fftSize_}
   {
-    blockSize_ = fftSize_ / 2 + 1;
+    blockSize_ = getSpectrumSize(fftSize_);
     numBlocks_ = (h.size() + subFilterSize_ - 1) / subFilterSize_;
 
-    H_ = new(std::align_val_t(64))
-        std::complex<float>[blockSize_ * numBlocks_];  // make each block cache line aligned
-    delayLine_ = new(std::align_val_t(64)) std::complex<float>[blockSize_ * numBlocks_];
+    // use spectra mapped from cache in place if available
+    H_ = cache ? cache->getSpectra(blockSize_ * numBlocks_) : nullptr;
 
-    clearDelayLine();
-    transformFilterCoeffs(h);
+    if(H_ == nullptr)
+    {
+      // each block is cache line aligned
+      auto spectra = new(std::align_val_t(64)) float[blockSize_ * numBlocks_]();
+      transformFilterCoeffs(h, spectra);
+
+      H_ = spectra;
+      ownsSpectra_ = true;
+
+      if(cache)
+      {
+        cache->addSpectra(H_, blockSize_ * numBlocks_);
+      }
+    }
   }
 
-  ~Convolution()
+  virtual ~Convolution()
   {
-    delete[] H_;
-    delete[] delayLine_;
+    if(ownsSpectra_)
+    {
+      delete[] H_;
+    }
   }
 
   static std::tuple<TaskType, RealData> getInputTask(uint32_t inputBlockSize)
@@ -185,43 +191,185 @@ public:
     auto overlapBuffer = std::shared_ptr<float>(new(std::align_val_t(64)) float[subFilterSize]);  // align mem
     memset(overlapBuffer.get(), 0, sizeof(float) * subFilterSize);
 
-    auto fft = Task::create<ComplexData>(
+    // spectra go straight into the delay line shared by all filters on this input
+    auto fft = Task::create<FrequencyDelayLine>(
         [subFilterSize, inputBlockSize, forwardFft, overlapBuffer](Task& task) {
           auto inputBuffer = forwardFft->input_.last(subFilterSize);
           memcpy(forwardFft->input_.data(), overlapBuffer.get(), (subFilterSize) * sizeof(float));
           memcpy(overlapBuffer.get(), inputBuffer.data(), inputBuffer.size() * sizeof(float));
-          forwardFft->run();
+          forwardFft->run(task.getArtifact<FrequencyDelayLine>().push());
         },
         {},
-        forwardFft->output_.subspan(0),
+        FrequencyDelayLine(forwardFft->output_.size()),
         [overlapBuffer, subFilterSize]() { memset(overlapBuffer.get(), 0, sizeof(float) * subFilterSize); });
+    fft->setLabel("fft");
 
     return {fft, forwardFft->input_.last(inputBlockSize)};
   }
 
+  // input tasks of numChannels channels sharing one batched forward FFT: the batch task is the
+  // only root, the channel tasks copy the spectra into their delay lines and are the inputs of
+  // the filters (see getOutputTasks)
+  static std::tuple<TaskType, std::vector<TaskType>, std::vector<RealData>> getBatchedInputTasks(
+      uint32_t inputBlockSize, uint32_t numChannels)
+  {
+    auto subFilterSize = inputBlockSize;
+    auto forwardFft = std::make_shared<BatchedForwardFFT>(inputBlockSize + subFilterSize, numChannels);
+    auto overlapBuffer = std::shared_ptr<float>(new(std::align_val_t(64)) float[subFilterSize * numChannels]);
+    memset(overlapBuffer.get(), 0, sizeof(float) * subFilterSize * numChannels);
+
+    auto batch = Task::create<uint32_t>(
+        [subFilterSize, numChannels, forwardFft, overlapBuffer](Task& task) {
+          for(uint32_t i{0}; i < numChannels; ++i)
+          {
+            auto input = forwardFft->getInput(i);
+            auto overlap = overlapBuffer.get() + i * subFilterSize;
+            memcpy(input.data(), overlap, subFilterSize * sizeof(float));
+            memcpy(overlap, input.last(subFilterSize).data(), subFilterSize * sizeof(float));
+          }
+          forwardFft->run();
+        },
+        {},
+        0,
+        [overlapBuffer, subFilterSize, numChannels]() {
+          memset(overlapBuffer.get(), 0, sizeof(float) * subFilterSize * numChannels);
+        });
+    batch->setLabel("batched fft");
+
+    std::vector<TaskType> channels;
+    std::vector<RealData> inputs;
+    for(uint32_t i{0}; i < numChannels; ++i)
+    {
+      auto spectrum = forwardFft->getOutput(i);
+      channels.push_back(Task::create<FrequencyDelayLine>(
+          [spectrum](Task& task) {
+            memcpy(task.getArtifact<FrequencyDelayLine>().push(), spectrum.data(), spectrum.size_bytes());
+          },
+          {batch},
+          FrequencyDelayLine(spectrum.size())));
+      channels.back()->setLabel("spectrum copy");
+      inputs.push_back(forwardFft->getInput(i).last(inputBlockSize));
+    }
+
+    return {batch, channels, inputs};
+  }
+
+  // one filter feeding into the output
+  struct Source
+  {
+    Convolution* convolution;
+    TaskType input;       // see getInputTask
+    RealData inputBlock;  // only read by filters with a tail (see NonUniformConvolution)
+  };
+
   std::tuple<std::vector<TaskType>, RealData> getOutputTasks(TaskType input, uint32_t combineBlocks = 4)
   {
-    auto rootTask = Task::create<uint32_t>([](Task& task) {});
+    return getMixTasks({{this, input, {}}}, combineBlocks);
+  }
+
+  // sum of filters of the same block size: their spectra are accumulated before a single
+  // inverse FFT (the one of the first filter), tails are added in time domain
+  static std::tuple<std::vector<TaskType>, RealData> getMixTasks(const std::vector<Source>& sources,
+                                                                 uint32_t combineBlocks = 4)
+  {
+    auto rootTask = Task::create<uint32_t>([](Task& task) {})->setLabel("root");
+    auto& target = *sources[0].convolution;
+
+    auto spectrum = getSpectrumTasks(rootTask, sources, target.inverseFft_.input_, combineBlocks);
+    auto resultTask = Task::create<RealData>([&target](Task& task) { target.inverseFft_.run(); },
+                                             {spectrum},
+                                             target.inverseFft_.output_.subspan(target.subFilterSize_));
+    resultTask->setLabel("ifft");
+
+    auto finalTask = getTailTask(rootTask, sources, resultTask, resultTask->getArtifact<RealData>());
+    return {{rootTask, finalTask}, finalTask->getArtifact<RealData>()};
+  }
+
+  // combine tasks of all sources chained on spectrum, returns the last one
+  static TaskType getSpectrumTasks(TaskType rootTask,
+                                   const std::vector<Source>& sources,
+                                   SpectrumData spectrum,
+                                   uint32_t combineBlocks = 4)
+  {
+    TaskType last = nullptr;
+    for(auto& [convolution, input, inputBlock] : sources)
+    {
+      assert(convolution->fftSize_ == sources[0].convolution->fftSize_ &&
+             "Mixed filters need the same block size");
+      last = convolution->getSpectrumTask(rootTask, input, spectrum.subspan(0), last, combineBlocks);
+    }
+
+    return last;
+  }
+
+  // tails of the sources added to output (the block of the inverse FFT done by resultTask),
+  // returns resultTask if there are none
+  static TaskType getTailTask(TaskType rootTask,
+                              const std::vector<Source>& sources,
+                              TaskType resultTask,
+                              RealData output)
+  {
+    std::vector<TaskType> deps{resultTask};
+    std::vector<Convolution*> tails;
+    for(auto& [convolution, input, inputBlock] : sources)
+    {
+      auto tailTasks = convolution->getTailTasks(rootTask, input, inputBlock);
+      if(tailTasks.size() > 0)
+      {
+        deps.insert(deps.end(), tailTasks.begin(), tailTasks.end());
+        tails.push_back(convolution);
+      }
+    }
+
+    if(tails.size() == 0)
+    {
+      return resultTask;
+    }
+
+    auto tailTask = Task::create<RealData>(
+        [tails](Task& task) {
+          auto& result = task.getArtifact<RealData>();
+          for(auto tail : tails)
+          {
+            tail->addTail(result);
+          }
+        },
+        deps,
+        std::move(output));
+    return tailTask->setLabel("tail");
+  }
+
+  virtual void clearDelayLine()
+  {
+    if(delayLine_)
+    {
+      delayLine_->clear();
+    }
+  }
+
+protected:
+  // spectrum of the current block into spectrum, after previous (another filter writing the
+  // same spectrum) it is added instead
+  TaskType getSpectrumTask(
+      TaskType rootTask, TaskType input, SpectrumData spectrum, TaskType previous, uint32_t combineBlocks)
+  {
+    delayLine_ = &input->getArtifact<FrequencyDelayLine>();
+    delayLine_->resize(numBlocks_);
 
     // first level multiply and add
     std::vector<TaskType> deps;
-    deps.push_back(input);
     for(uint32_t i{1}; i < numBlocks_; i += combineBlocks)
     {
-      deps.push_back(Task::create<ComplexVec>(
+      deps.push_back(Task::create<SpectrumVec>(
           [this, i, combineBlocks](Task& task) {
-            multiplyAddBlocks(i, task.getArtifact<ComplexVec>(), combineBlocks);
+            multiplyAddBlocks(i, task.getArtifact<SpectrumVec>(), combineBlocks);
           },
           {rootTask},
-          ComplexVec(blockSize_)));
+          SpectrumVec(blockSize_)));
+      deps.back()->setLabel("multiplyAddBlocks");
     }
 
-    // move block
-    auto shift = Task::create<ComplexData>(
-        [this](Task& task) { pushBlock(task.getDependencies()[0]->getArtifact<ComplexData>().data()); },
-        deps);
-
-    std::list<TaskType> sumUpTasks{deps.begin() + 1, deps.end()};
+    std::list<TaskType> sumUpTasks{deps.begin(), deps.end()};
     while(sumUpTasks.size() > 1)
     {
       uint32_t numDeps = std::min<uint32_t>(std::max<uint32_t>(2, combineBlocks), sumUpTasks.size());
@@ -233,63 +381,78 @@ public:
         sumUpTasks.pop_front();
       }
 
-      sumUpTasks.push_back(Task::create<ComplexVec>(
-          [this](Task& task) { sumBlocks(task.getArtifact<ComplexVec>(), task.getDependencies()); },
+      sumUpTasks.push_back(Task::create<SpectrumVec>(
+          [this](Task& task) { sumBlocks(task.getArtifact<SpectrumVec>(), task.getDependencies()); },
           deps,
-          ComplexVec(blockSize_)));
+          SpectrumVec(blockSize_)));
+      sumUpTasks.back()->setLabel("sumBlocks");
     }
 
-    TaskType combine = nullptr;
+    // just one block => no need to sum up blocks
+    const float* older = nullptr;
+    deps = {input};
     if(sumUpTasks.size() > 0)
     {
-      combine = Task::create<ComplexData>(
-          [this](Task& task) {
-            auto result = task.getArtifact<ComplexData>().data();
-            for(auto& _ : std::span(H_, blockSize_))
-            {
-              multiply(result, H_, task.getDependencies()[0]->getArtifact<ComplexData>().data(), blockSize_);
-              add(result, result, task.getDependencies()[1]->getArtifact<ComplexVec>().data(), blockSize_);
-            }
-          },
-          {input, sumUpTasks.front()},
-          inverseFft_.input_.subspan(0));
+      older = sumUpTasks.front()->getArtifact<SpectrumVec>().data();
+      deps.push_back(sumUpTasks.front());
     }
-    else
+
+    bool accumulate = previous != nullptr;
+    if(accumulate)
     {
-      // just one block => no need to sum up blocks
-      combine = Task::create<ComplexData>(
-          [this](Task& task) {
-            auto result = task.getArtifact<ComplexData>().data();
-            for(auto& _ : std::span(H_, blockSize_))
-            {
-              multiply(result, H_, task.getDependencies()[0]->getArtifact<ComplexData>().data(), blockSize_);
-            }
-          },
-          {input},
-          inverseFft_.input_.subspan(0));
+      deps.push_back(previous);
     }
 
-    auto resultTask = Task::create<RealData>([this](Task& task) { inverseFft_.run(); },
-                                             {combine, shift},
-                                             inverseFft_.output_.subspan(subFilterSize_));
+    // combine runs after all reads of the delay line => move to next block afterwards
+    auto combineTask = Task::create<SpectrumData>(
+        [this, older, accumulate](Task& task) {
+          combine(task.getArtifact<SpectrumData>().data(), older, accumulate);
+          nextBlock();
+        },
+        deps,
+        std::move(spectrum));
+    return combineTask->setLabel("combine");
+  }
 
-    return {{rootTask, resultTask}, resultTask->getArtifact<RealData>()};
+  void combine(float* result, const float* older, bool accumulate) const
+  {
+    if(accumulate)
+    {
+      multiplyAdd(result, H_, delayLine_->getCurrent(), blockSize_);
+      if(older)
+      {
+        add(result, result, older, blockSize_);
+      }
+    }
+    else if(older)
+    {
+      multiplyAccumulate(result, H_, delayLine_->getCurrent(), older, blockSize_);
+    }
+    else
+    {
+      multiply(result, H_, delayLine_->getCurrent(), blockSize_);
+    }
+  }
+
+  // part of the filter processed outside of the block spectrum, added to the output by addTail
+  // after the returned tasks
+  virtual std::vector<TaskType> getTailTasks(TaskType rootTask, TaskType input, const RealData& inputBlock)
+  {
+    return {};
   }
 
-  void clearDelayLine() { memset(delayLine_, 0, blockSize_ * numBlocks_ * sizeof(delayLine_[0])); }
+  virtual void addTail(RealData& output) const {}
 
-protected:
   static uint32_t getSubFilterSize(uint32_t inputBlockSize)
   {
     return (1 << static_cast<uint32_t>(std::ceil(std::log2(inputBlockSize) + 1))) - inputBlockSize;
   }
 
-  void transformFilterCoeffs(const std::span<const float> h)
+  void transformFilterCoeffs(const std::span<const float> h, float* spectra)
   {
     ForwardFFT fft{fftSize_};
 
     const float* src = h.data();
-    std::complex<float>* dst = H_;
     for(uint32_t i{0}; i < numBlocks_; ++i)
     {
       for(auto& f : fft.input_.subspan(0, subFilterSize_))
@@ -302,16 +465,11 @@ protected:
         f = 0.0f;
       }
 
-      fft.run();
-
-      for(auto f : fft.output_)
-      {
-        *(dst++) = f;
-      }
+      fft.run(spectra + blockSize_ * i);
     }
   }
 
-  void multiplyAddBlocks(uint32_t index, ComplexVec& result, uint32_t numBlocks = 1) const
+  void multiplyAddBlocks(uint32_t index, SpectrumVec& result, uint32_t numBlocks = 1) const
   {
     multiply(result.data(), H_ + (blockSize_ * index), getBlock(index), blockSize_);
 
@@ -322,40 +480,42 @@ protected:
     }
   }
 
-  void sumBlocks(ComplexVec& result, const std::vector<TaskType>& operands) const
+  void sumBlocks(SpectrumVec& result, const std::vector<TaskType>& operands) const
   {
     add(result.data(),
-        operands[0]->getArtifact<ComplexData>().data(),
-        operands[1]->getArtifact<ComplexData>().data(),
+        operands[0]->getArtifact<SpectrumVec>().data(),
+        operands[1]->getArtifact<SpectrumVec>().data(),
         blockSize_);
 
     for(uint32_t i{2}; i < operands.size(); ++i)
     {
-      add(result.data(), result.data(), operands[i]->getArtifact<ComplexData>().data(), blockSize_);
+      add(result.data(), result.data(), operands[i]->getArtifact<SpectrumVec>().data(), blockSize_);
     }
   }
 
-  void pushBlock(std::complex<float>* Hdata)
+  void pushBlock(const float* Hdata)
   {
     memcpy(getBlock(0), Hdata, blockSize_ * sizeof(Hdata[0]));
-    firstBlock_ = (++firstBlock_ == numBlocks_) ? 0 : firstBlock_;
+    nextBlock();
   }
 
+  // delay line is shared => each filter keeps its own read position
+  void nextBlock() { firstBlock_ = (firstBlock_ + 1 == delayLine_->getNumBlocks()) ? 0 : firstBlock_ + 1; }
+
   uint32_t getNumBlocks() const { return numBlocks_; }
 
-  std::complex<float>* getBlock(uint32_t index) const
+  float* getBlock(uint32_t index) const
   {
-    auto i = static_cast<int32_t>(index) - firstBlock_;
-    i += (i < 0) ? numBlocks_ : 0;
-    return delayLine_ + i * blockSize_;
+    return delayLine_->getSlot(index + delayLine_->getNumBlocks() - firstBlock_);
   }
 
   uint32_t subFilterSize_;
   uint32_t fftSize_;
   int32_t numBlocks_;
   uint32_t blockSize_;
-  std::complex<float>* H_;
-  std::complex<float>* delayLine_;
-  int32_t firstBlock_{0};
+  const float* H_;
+  bool ownsSpectra_{false};
+  FrequencyDelayLine* delayLine_{nullptr};
+  uint32_t firstBlock_{0};
   BackwardFFT inverseFft_;
 };
\ No newline at end of file
@@ -3,23 +3,65 @@
 #include <fftw3.h>
 #include <stdint.h>
 
-#include <complex>
+#include <new>
 #include <span>
+#include <vector>
 
-using ComplexData = std::span<std::complex<float>>;
 using RealData = std::span<float>;
 
+// Spectra are stored split complex: all real parts followed by all imaginary parts. Each half
+// holds the fftSize / 2 + 1 bins padded with zeros to a full cache line, so every spectrum
+// starts aligned and SIMD loops never need a tail.
+using SpectrumData = std::span<float>;
+
+static constexpr uint32_t kSpectrumAlignment = 64 / sizeof(float);
+
+// number of floats of a padded split complex spectrum
+inline uint32_t getSpectrumSize(uint32_t fftSize)
+{
+  return 2 * ((fftSize / 2 + 1 + kSpectrumAlignment - 1) & ~(kSpectrumAlignment - 1));
+}
+
+template <typename T>
+struct AlignedAllocator
+{
+  using value_type = T;
+
+  AlignedAllocator() = default;
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U>&)
+  {
+  }
+
+  T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(64))); }
+  void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(64)); }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U>&) const
+  {
+    return true;
+  }
+};
+
+using SpectrumVec = std::vector<float, AlignedAllocator<float>>;
+
 struct ForwardFFT
 {
 public:
-  ForwardFFT(uint32_t size, bool measure = true)
+  ForwardFFT(uint32_t size, unsigned planFlags = FFTW_MEASURE)
       : input_{new(std::align_val_t(64)) float[size], size},
-        output_{new(std::align_val_t(64)) std::complex<float>[size / 2 + 1], size / 2 + 1}
+        output_{new(std::align_val_t(64)) float[getSpectrumSize(size)](), getSpectrumSize(size)}
   {
-    plan_ = fftwf_plan_dft_r2c_1d(size,
-                                  input_.data(),
-                                  reinterpret_cast<fftwf_complex*>(output_.data()),
-                                  measure ? FFTW_MEASURE : FFTW_ESTIMATE);
+    fftwf_iodim dim{static_cast<int>(size), 1, 1};
+    plan_ = fftwf_plan_guru_split_dft_r2c(1,
+                                          &dim,
+                                          0,
+                                          nullptr,
+                                          input_.data(),
+                                          output_.data(),
+                                          output_.data() + output_.size() / 2,
+                                          planFlags);
   }
 
   ~ForwardFFT()
@@ -31,20 +73,27 @@ public:
 
   void run() { fftwf_execute(plan_); }
 
+  // output must be a padded spectrum with the same alignment as output_
+  void run(float* output)
+  {
+    fftwf_execute_split_dft_r2c(plan_, input_.data(), output, output + output_.size() / 2);
+  }
+
   RealData input_;
-  ComplexData output_;
+  SpectrumData output_;
   fftwf_plan plan_;
 };
 
 struct BackwardFFT
 {
 public:
-  BackwardFFT(uint32_t size)
-      : input_{new(std::align_val_t(64)) std::complex<float>[size / 2 + 1], size / 2 + 1},
+  BackwardFFT(uint32_t size, unsigned planFlags = FFTW_MEASURE)
+      : input_{new(std::align_val_t(64)) float[getSpectrumSize(size)](), getSpectrumSize(size)},
         output_{new(std::align_val_t(64)) float[size], size}
   {
-    plan_ = fftwf_plan_dft_c2r_1d(
-        size, reinterpret_cast<fftwf_complex*>(input_.data()), output_.data(), FFTW_MEASURE);
+    fftwf_iodim dim{static_cast<int>(size), 1, 1};
+    plan_ = fftwf_plan_guru_split_dft_c2r(
+        1, &dim, 0, nullptr, input_.data(), input_.data() + input_.size() / 2, output_.data(), planFlags);
   }
 
   ~BackwardFFT()
@@ -56,7 +105,101 @@ public:
 
   void run() { fftwf_execute(plan_); }
 
-  ComplexData input_;
+  SpectrumData input_;
   RealData output_;
   fftwf_plan plan_;
-};
\ No newline at end of file
+};
+
+// floats between the real arrays of a batch => each one starts cache line aligned
+inline uint32_t getRealStride(uint32_t fftSize)
+{
+  return (fftSize + kSpectrumAlignment - 1) & ~(kSpectrumAlignment - 1);
+}
+
+// howmany transforms of the same size in a single plan over contiguous buffers: one plan
+// dispatch per block instead of one per channel, FFTW may vectorize across the transforms
+struct BatchedForwardFFT
+{
+public:
+  BatchedForwardFFT(uint32_t size, uint32_t howmany, unsigned planFlags = FFTW_MEASURE)
+      : size_{size},
+        stride_{getRealStride(size)},
+        spectrumSize_{getSpectrumSize(size)},
+        howmany_{howmany},
+        input_{new(std::align_val_t(64)) float[stride_ * howmany]()},
+        output_{new(std::align_val_t(64)) float[spectrumSize_ * howmany]()}
+  {
+    fftwf_iodim dim{static_cast<int>(size), 1, 1};
+    fftwf_iodim batch{static_cast<int>(howmany), static_cast<int>(stride_), static_cast<int>(spectrumSize_)};
+    plan_ = fftwf_plan_guru_split_dft_r2c(
+        1, &dim, 1, &batch, input_, output_, output_ + spectrumSize_ / 2, planFlags);
+  }
+
+  BatchedForwardFFT(const BatchedForwardFFT&) = delete;
+  BatchedForwardFFT& operator=(const BatchedForwardFFT&) = delete;
+
+  ~BatchedForwardFFT()
+  {
+    fftwf_destroy_plan(plan_);
+    delete[] input_;
+    delete[] output_;
+  }
+
+  void run() { fftwf_execute(plan_); }
+
+  uint32_t getHowmany() const { return howmany_; }
+  RealData getInput(uint32_t i) const { return {input_ + i * stride_, size_}; }
+  SpectrumData getOutput(uint32_t i) const { return {output_ + i * spectrumSize_, spectrumSize_}; }
+
+protected:
+  uint32_t size_;
+  uint32_t stride_;
+  uint32_t spectrumSize_;
+  uint32_t howmany_;
+  float* input_;
+  float* output_;
+  fftwf_plan plan_;
+};
+
+struct BatchedBackwardFFT
+{
+public:
+  BatchedBackwardFFT(uint32_t size, uint32_t howmany, unsigned planFlags = FFTW_MEASURE)
+      : size_{size},
+        stride_{getRealStride(size)},
+        spectrumSize_{getSpectrumSize(size)},
+        howmany_{howmany},
+        input_{new(std::align_val_t(64)) float[spectrumSize_ * howmany]()},
+        output_{new(std::align_val_t(64)) float[stride_ * howmany]()}
+  {
+    fftwf_iodim dim{static_cast<int>(size), 1, 1};
+    fftwf_iodim batch{static_cast<int>(howmany), static_cast<int>(spectrumSize_), static_cast<int>(stride_)};
+    plan_ = fftwf_plan_guru_split_dft_c2r(
+        1, &dim, 1, &batch, input_, input_ + spectrumSize_ / 2, output_, planFlags);
+  }
+
+  BatchedBackwardFFT(const BatchedBackwardFFT&) = delete;
+  BatchedBackwardFFT& operator=(const BatchedBackwardFFT&) = delete;
+
+  ~BatchedBackwardFFT()
+  {
+    fftwf_destroy_plan(plan_);
+    delete[] input_;
+    delete[] output_;
+  }
+
+  void run() { fftwf_execute(plan_); }
+
+  uint32_t getHowmany() const { return howmany_; }
+  SpectrumData getInput(uint32_t i) const { return {input_ + i * spectrumSize_, spectrumSize_}; }
+  RealData getOutput(uint32_t i) const { return {output_ + i * stride_, size_}; }
+
+protected:
+  uint32_t size_;
+  uint32_t stride_;
+  uint32_t spectrumSize_;
+  uint32_t howmany_;
+  float* input_;
+  float* output_;
+  fftwf_plan plan_;
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <fftw3.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "fft.h"
+#include "fir_crossover.h"
+
+// Persistent FFTW wisdom: plans created with the same size, layout and alignment are
+// restored from the wisdom file instead of being measured again on every stream open.
+//
+// Wisdom of a more rigorous planner (e.g. FFTW_PATIENT from the offline tool) is reused
+// for FFTW_MEASURE requests.
+class FftWisdom
+{
+public:
+  explicit FftWisdom(const std::string& path) : path_{path}
+  {
+    if(path_.length() > 0)
+    {
+      fftwf_import_wisdom_from_filename(path_.c_str());
+    }
+
+    imported_ = exportString();
+  }
+
+  // planning added plans not in the wisdom file
+  bool hasNewWisdom() const { return exportString() != imported_; }
+
+  // write wisdom back if planning added something new, replaces the file atomically
+  bool store() const
+  {
+    if(path_.length() == 0 || !hasNewWisdom())
+    {
+      return true;
+    }
+
+    // unique name => streams storing at the same time do not write into each other's file
+    std::string tmpPath = path_ + ".XXXXXX";
+    auto fd = mkstemp(tmpPath.data());
+    if(fd < 0)
+    {
+      return false;
+    }
+
+    // the export reopens it by name
+    bool created = fchmod(fd, 0644) == 0 && close(fd) == 0;
+    if(!created || !fftwf_export_wisdom_to_filename(tmpPath.c_str()) ||
+       std::rename(tmpPath.c_str(), path_.c_str()) != 0)
+    {
+      std::remove(tmpPath.c_str());
+      return false;
+    }
+
+    return true;
+  }
+
+  // what a crossover plans, see FirMultiChannelCrossover
+  struct Layout
+  {
+    uint32_t blockSize;
+    uint32_t maxFilterSize{65536};  // taps of the longest filter => non-uniform segments
+    uint32_t numInputs{0};          // > 0 => batched plans (batchedFft)
+    uint32_t numOutputs{0};
+    uint32_t numThreads{3};
+  };
+
+  // 2 * blockSize for the inputs and the uniform filters, 2 * partition size of each
+  // non-uniform segment, shorter filters use a subset
+  static std::vector<uint32_t> getFftSizes(uint32_t blockSize, uint32_t maxFilterSize)
+  {
+    std::vector<uint32_t> sizes{2 * blockSize};
+    for(auto& segment : NonUniformConvolution::getSegmentLayout(maxFilterSize, blockSize))
+    {
+      sizes.push_back(2 * segment.partitionSize);
+    }
+
+    return sizes;
+  }
+
+  // create all plans a crossover of this layout can ask for
+  static void plan(const Layout& layout, unsigned planFlags)
+  {
+    for(auto fftSize : getFftSizes(layout.blockSize, layout.maxFilterSize))
+    {
+      ForwardFFT forward{fftSize, planFlags};
+      BackwardFFT backward{fftSize, planFlags};
+    }
+
+    // guru plans are specific to the number of transforms
+    if(layout.numInputs > 0)
+    {
+      BatchedForwardFFT forward{2 * layout.blockSize, layout.numInputs, planFlags};
+      for(auto howmany : FirMultiChannelCrossover::getBatchSizes(layout.numOutputs, layout.numThreads))
+      {
+        BatchedBackwardFFT backward{2 * layout.blockSize, howmany, planFlags};
+      }
+    }
+  }
+
+protected:
+  static std::string exportString()
+  {
+    auto wisdom = fftwf_export_wisdom_to_string();
+    std::string result{wisdom ? wisdom : ""};
+    free(wisdom);
+    return result;
+  }
+
+  std::string path_;
+  std::string imported_;
+};
@@ -2,12 +2,16 @@
 
 #include <stdint.h>
 
+#include <algorithm>
 #include <cassert>
 #include <list>
 #include <vector>
 
+#include "../tasks/static_schedule.h"
 #include "../tasks/tasks.h"
 #include "convolution.h"
+#include "non_uniform_convolution.h"
+#include "spectrum_cache.h"
 
 using TaskType = std::shared_ptr<Task>;
 
@@ -15,47 +19,221 @@ class FirMultiChannelCrossover
 {
 public:
   using ArtifactType = std::vector<fftw_complex>;
-  using ConfigType = std::pair<uint32_t, RealData>;
 
+  enum class Partitioning
+  {
+    Uniform,
+    NonUniform
+  };
+
+  static constexpr uint32_t kOwnOutput = ~0U;
+
+  // filters with the same output are summed into it, outputs are numbered in the order they
+  // first appear
+  struct ConfigType
+  {
+    uint32_t inputChannel;
+    std::span<const float> h;
+    Partitioning partitioning{Partitioning::Uniform};
+    uint32_t output{kOwnOutput};
+  };
+
+  // batchedFft => forward FFTs of all inputs in one plan and inverse FFTs in a few balanced
+  // batches (one per thread), fewer plan dispatches and tasks for small block sizes
+  //
+  // zeroLatency => the first blockSize taps of each filter run in time domain on the samples
+  // of the current block (see processHead), the FFT partitions take the rest one block later
   FirMultiChannelCrossover(uint32_t blockSize,
                            uint32_t numInputChannels,
                            const std::vector<ConfigType>& channelFilters,
-                           uint32_t threads = 3)
-      : runner_{threads}
+                           uint32_t threads = 3,
+                           std::shared_ptr<SpectrumCache> cache = nullptr,
+                           bool batchedFft = false,
+                           bool zeroLatency = false)
+      : cache_{cache}, blockSize_{blockSize}, numThreads_{threads}, runner_{threads}
   {
-    for(auto i{0}; i < numInputChannels; ++i)
+    // events of a previous crossover name tasks that are gone (or reuse their addresses)
+    if constexpr(kTaskProfiling)
     {
-      auto [inputJob, input] = Convolution::getInputTask(blockSize);
-      inputJobs_.push_back(inputJob);
-      inputBuffer_.push_back(input);
+      TaskProfiler::global().clear();
     }
 
-    std::vector<TaskType> finalDeps;
-    for(auto& [inputChannel, h] : channelFilters)
+    std::vector<TaskType> channelInputs;
+    if(batchedFft)
+    {
+      auto [batch, channels, inputs] = Convolution::getBatchedInputTasks(blockSize, numInputChannels);
+      inputJobs_.push_back(batch);
+      channelInputs = channels;
+      inputBuffer_ = inputs;
+    }
+    else
     {
-      auto conv = std::make_unique<Convolution>(h, blockSize);
-      auto [backgroundJobs, output] = conv->getOutputTasks(inputJobs_[inputChannel]);
+      for(auto i{0}; i < numInputChannels; ++i)
+      {
+        auto [inputJob, input] = Convolution::getInputTask(blockSize);
+        inputJobs_.push_back(inputJob);
+        inputBuffer_.push_back(input);
+      }
+      channelInputs = inputJobs_;
+    }
+
+    std::vector<std::vector<Convolution::Source>> outputs;
+    std::vector<uint32_t> outputIds;
+    for(auto& [inputChannel, h, partitioning, output] : channelFilters)
+    {
+      auto id = std::find(outputIds.begin(), outputIds.end(), output);
+      if(output == kOwnOutput || id == outputIds.end())
+      {
+        outputIds.push_back(output);
+        outputs.emplace_back();
+        id = outputIds.end() - 1;
+      }
+
+      // tail = filter delayed by one block, its output is due with the next block
+      auto fftPart = h;
+      if(zeroLatency)
+      {
+        auto head = h.first(std::min<size_t>(h.size(), blockSize));
+        uint32_t outputIndex = id - outputIds.begin();
+        heads_.push_back({inputChannel, outputIndex, {head.begin(), head.end()}});
+        fftPart = h.size() > blockSize ? h.subspan(blockSize) : std::span<const float>(kNoTail);
+      }
 
-      outputBuffer_.push_back(output);
-      assert(backgroundJobs[1]->isFinal() && "Task must be a final task");
-      finalDeps.push_back(backgroundJobs[1]);
-      backgroundJobs_.insert(backgroundJobs_.end(), backgroundJobs.begin(), backgroundJobs.end());
+      std::unique_ptr<Convolution> conv;
+      if(partitioning == Partitioning::NonUniform)
+      {
+        conv = std::make_unique<NonUniformConvolution>(fftPart, blockSize, cache.get());
+      }
+      else
+      {
+        conv = std::make_unique<Convolution>(fftPart, blockSize, cache.get());
+      }
+
+      outputs[id - outputIds.begin()].push_back(
+          {conv.get(), channelInputs[inputChannel], inputBuffer_[inputChannel]});
       convolutions_.push_back(std::move(conv));
     }
 
+    // spectra of filters summed into one output share a single inverse FFT
+    std::vector<TaskType> finalDeps;
+    if(batchedFft)
+    {
+      finalDeps = getBatchedOutputTasks(outputs, blockSize);
+    }
+    else
+    {
+      for(auto& sources : outputs)
+      {
+        auto [backgroundJobs, output] = Convolution::getMixTasks(sources);
+
+        outputBuffer_.push_back(output);
+        assert(backgroundJobs[1]->isFinal() && "Task must be a final task");
+        finalDeps.push_back(backgroundJobs[1]);
+        backgroundJobs_.insert(backgroundJobs_.end(), backgroundJobs.begin(), backgroundJobs.end());
+      }
+    }
+
     // combine final jobs into one
-    auto combined = Task::create<int>([](Task&) {}, finalDeps);
+    auto combined = Task::create<int>([](Task&) {}, finalDeps)->setLabel("final");
     backgroundJobs_.push_back(combined);
 
     runner_.run(backgroundJobs_, false);
-  }
 
-  ~FirMultiChannelCrossover() { fftwf_cleanup(); }
+    if(zeroLatency)
+    {
+      // inputs are written next to the previous block the heads read as history, the outputs
+      // of the FFT partitions become the tails added to the next block
+      fftInput_ = inputBuffer_;
+      tailOutput_ = outputBuffer_;
+      history_.assign(numInputChannels, SpectrumVec(2 * blockSize));
+      headOutput_.assign(outputBuffer_.size(), SpectrumVec(blockSize));
+
+      inputBuffer_.clear();
+      for(auto& history : history_)
+      {
+        inputBuffer_.push_back(RealData(history).subspan(blockSize));
+      }
+
+      outputBuffer_.clear();
+      for(auto& output : headOutput_)
+      {
+        outputBuffer_.push_back(output);
+      }
+
+      // the first block already reads the tails
+      resetFilterState();
+    }
+  }
 
   void updateInputs()
   {
-    runner_.run(inputJobs_);
-    runner_.run(backgroundJobs_, false);
+    for(uint32_t i{0}; i < history_.size(); ++i)
+    {
+      std::copy_n(history_[i].begin() + blockSize_, blockSize_, fftInput_[i].begin());
+      std::copy_n(history_[i].begin() + blockSize_, blockSize_, history_[i].begin());
+    }
+
+    finishBlock();
+    startBlock();
+  }
+
+  // zero latency: outputs [offset, offset + frames) of the current block as soon as its inputs
+  // are written there (before updateInputs of this block)
+  void processHead(uint32_t offset, uint32_t frames)
+  {
+    assert(offset + frames <= blockSize_);
+
+    for(uint32_t i{0}; i < headOutput_.size(); ++i)
+    {
+      std::copy_n(tailOutput_[i].begin() + offset, frames, headOutput_[i].begin() + offset);
+    }
+
+    for(auto& [input, output, h] : heads_)
+    {
+      fir(headOutput_[output].data() + offset,
+          h.data(),
+          history_[input].data() + blockSize_ + offset,
+          h.size(),
+          frames);
+    }
+  }
+
+  bool isZeroLatency() const { return heads_.size() > 0; }
+
+  // replace dynamic scheduling by a fixed per thread execution list built from the measured
+  // task costs, resets the filter state
+  void compileSchedule(uint32_t rounds = 32)
+  {
+    finishBlock();
+
+    std::vector<TaskType> tasks(inputJobs_);
+    tasks.insert(tasks.end(), backgroundJobs_.begin(), backgroundJobs_.end());
+    auto costs = StaticSchedule::measure(tasks, rounds);
+
+    schedule_ = std::make_unique<StaticSchedule>(inputJobs_, backgroundJobs_, numThreads_, costs);
+    schedule_->configure(threadConfig_);
+
+    clearState();
+    startBlock();
+    updateInputs();
+    updateInputs();
+  }
+
+  // realtime policy and cpu affinity of the workers, kept for a schedule compiled later
+  // returns 0 or the first error (errno value)
+  int configureThreads(const ThreadConfig& config)
+  {
+    threadConfig_ = config;
+    return schedule_ ? schedule_->configure(config) : runner_.configure(config);
+  }
+
+  // idle wait statistics of the dynamic scheduler
+  TaskRunner::WaitStats getWaitStats() const { return runner_.getWaitStats(); }
+
+  // cpu time of the workers running the blocks (those of the static schedule once compiled)
+  std::vector<std::chrono::nanoseconds> getWorkerCpuTimes()
+  {
+    return schedule_ ? schedule_->getCpuTimes() : runner_.getCpuTimes();
   }
 
   const RealData& getInputBuffer(uint32_t inputChannel) const
@@ -71,6 +249,104 @@ public:
   }
 
   void resetFilterState()
+  {
+    // finish the block in flight => no task touches the state while it is cleared
+    finishBlock();
+    clearState();
+
+    // update internal state
+    startBlock();
+    updateInputs();
+    updateInputs();
+  }
+
+  // outputs per inverse FFT batch with batchedFft: one balanced batch per thread
+  static std::vector<uint32_t> getBatchSizes(uint32_t numOutputs, uint32_t threads)
+  {
+    std::vector<uint32_t> sizes;
+    uint32_t numBatches = std::min(std::max(1U, threads), numOutputs);
+    for(uint32_t b{0}; b < numBatches; ++b)
+    {
+      sizes.push_back((b + 1) * numOutputs / numBatches - b * numOutputs / numBatches);
+    }
+
+    return sizes;
+  }
+
+protected:
+  // outputs split into balanced batches, one inverse FFT task per batch, returns the final tasks
+  std::vector<TaskType> getBatchedOutputTasks(const std::vector<std::vector<Convolution::Source>>& outputs,
+                                              uint32_t blockSize)
+  {
+    std::vector<TaskType> finalDeps;
+
+    uint32_t first{0};
+    for(auto batchSize : getBatchSizes(outputs.size(), numThreads_))
+    {
+      uint32_t last = first + batchSize;
+      inverseFfts_.push_back(std::make_unique<BatchedBackwardFFT>(2 * blockSize, batchSize));
+      auto fft = inverseFfts_.back().get();
+
+      std::vector<TaskType> roots;
+      std::vector<TaskType> spectra;
+      for(uint32_t i{first}; i < last; ++i)
+      {
+        roots.push_back(Task::create<uint32_t>([](Task& task) {})->setLabel("root"));
+        spectra.push_back(Convolution::getSpectrumTasks(roots.back(), outputs[i], fft->getInput(i - first)));
+      }
+
+      auto batch = Task::create<uint32_t>([fft](Task& task) { fft->run(); }, spectra);
+      batch->setLabel("batched ifft");
+      backgroundJobs_.insert(backgroundJobs_.end(), roots.begin(), roots.end());
+      finalDeps.push_back(batch);
+
+      for(uint32_t i{first}; i < last; ++i)
+      {
+        auto output = fft->getOutput(i - first).subspan(blockSize);
+        auto tail = Convolution::getTailTask(roots[i - first], outputs[i], batch, output);
+
+        outputBuffer_.push_back(output);
+        if(tail != batch)
+        {
+          backgroundJobs_.push_back(tail);
+          finalDeps.push_back(tail);
+        }
+      }
+
+      first = last;
+    }
+
+    return finalDeps;
+  }
+
+  void startBlock()
+  {
+    if constexpr(kTaskProfiling)
+    {
+      TaskProfiler::global().nextBlock();
+    }
+
+    if(schedule_)
+    {
+      schedule_->startBlock();
+      return;
+    }
+
+    runner_.run(backgroundJobs_, false);
+  }
+
+  void finishBlock()
+  {
+    if(schedule_)
+    {
+      schedule_->finishBlock();
+      return;
+    }
+
+    runner_.run(inputJobs_);
+  }
+
+  void clearState()
   {
     for(auto in : inputJobs_)
     {
@@ -87,16 +363,42 @@ public:
       std::fill(in.begin(), in.end(), 0.0f);
     }
 
-    // update internal state
-    updateInputs();
-    updateInputs();
+    for(auto& history : history_)
+    {
+      std::fill(history.begin(), history.end(), 0.0f);
+    }
+
+    for(auto& in : fftInput_)
+    {
+      std::fill(in.begin(), in.end(), 0.0f);
+    }
   }
 
-protected:
-  TaskRunner runner_;
+  // time domain part of a filter in zero latency mode
+  struct Head
+  {
+    uint32_t input;
+    uint32_t output;
+    std::vector<float> h;
+  };
+
+  static constexpr float kNoTail[1]{0.0f};
+
+  std::shared_ptr<SpectrumCache> cache_;  // spectra may be mapped from here => outlive convolutions
   std::vector<TaskType> inputJobs_;
   std::vector<TaskType> backgroundJobs_;
   std::vector<RealData> inputBuffer_;
   std::vector<RealData> outputBuffer_;
   std::list<std::unique_ptr<Convolution>> convolutions_;
+  std::vector<std::unique_ptr<BatchedBackwardFFT>> inverseFfts_;  // only with batchedFft
+  std::vector<Head> heads_;                                        // only with zeroLatency
+  std::vector<SpectrumVec> history_;     // per input: previous block, current block
+  std::vector<SpectrumVec> headOutput_;  // per output
+  std::vector<RealData> fftInput_;
+  std::vector<RealData> tailOutput_;
+  uint32_t blockSize_;
+  uint32_t numThreads_;
+  ThreadConfig threadConfig_;
+  TaskRunner runner_;  // destroyed after schedule_ and before the convolutions => workers are joined first
+  std::unique_ptr<StaticSchedule> schedule_;
 };
\ No newline at end of file
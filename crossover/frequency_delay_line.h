@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <cstring>
+#include <new>
+#include <utility>
+
+// Ring of input spectra shared by all filters of one input channel.
+//
+// The input task writes each new spectrum directly into the ring (push) while the filters
+// keep their own read position in lockstep. Padded spectra keep every slot cache line aligned,
+// so the forward FFT can write into any slot without changing the alignment of its plan.
+class FrequencyDelayLine
+{
+public:
+  explicit FrequencyDelayLine(uint32_t blockSize, uint32_t numBlocks = 1)
+      : blockSize_{blockSize}
+  {
+    resize(numBlocks);
+  }
+
+  FrequencyDelayLine(FrequencyDelayLine&& other)
+      : blockSize_{other.blockSize_},
+        numBlocks_{std::exchange(other.numBlocks_, 0)},
+        writeBlock_{other.writeBlock_},
+        data_{std::exchange(other.data_, nullptr)},
+        current_{std::exchange(other.current_, nullptr)}
+  {
+  }
+
+  FrequencyDelayLine(const FrequencyDelayLine&) = delete;
+  FrequencyDelayLine& operator=(const FrequencyDelayLine&) = delete;
+
+  ~FrequencyDelayLine() { delete[] data_; }
+
+  // grow the ring to hold at least numBlocks spectra (only while no tasks are running)
+  void resize(uint32_t numBlocks)
+  {
+    if(numBlocks <= numBlocks_)
+    {
+      return;
+    }
+
+    delete[] data_;
+    data_ = new(std::align_val_t(64)) float[blockSize_ * numBlocks];
+    numBlocks_ = numBlocks;
+    writeBlock_ = 0;
+    current_ = data_;
+
+    clear();
+  }
+
+  void clear() { memset(data_, 0, blockSize_ * numBlocks_ * sizeof(data_[0])); }
+
+  // slot for the next input spectrum; it becomes the current one
+  float* push()
+  {
+    current_ = getSlot(numBlocks_ - writeBlock_);
+    writeBlock_ = (writeBlock_ + 1 == numBlocks_) ? 0 : writeBlock_ + 1;
+    return current_;
+  }
+
+  float* getCurrent() const { return current_; }
+
+  float* getSlot(uint32_t slot) const
+  {
+    return data_ + (slot < numBlocks_ ? slot : slot - numBlocks_) * blockSize_;
+  }
+
+  uint32_t getBlockSize() const { return blockSize_; }
+  uint32_t getNumBlocks() const { return numBlocks_; }
+
+protected:
+  uint32_t blockSize_;
+  uint32_t numBlocks_{0};
+  uint32_t writeBlock_{0};
+  float* data_{nullptr};
+  float* current_{nullptr};
+};
@@ -1,48 +1,88 @@
 #pragma once
 
 #include <arm_neon.h>
+#include <stdint.h>
 
 namespace neon
 {
 
-inline void multiply(std::complex<float>* __restrict result,
-                     const std::complex<float>* __restrict src1,
-                     const std::complex<float>* __restrict src2)
+// 4 bins of a split complex spectrum, imaginary parts start at offset half
+
+inline void multiply(float* __restrict result,
+                     const float* __restrict src1,
+                     const float* __restrict src2,
+                     uint32_t half)
 {
-  auto a = vld2q_f32(reinterpret_cast<const float* __restrict>(src1));
-  auto b = vld2q_f32(reinterpret_cast<const float* __restrict>(src2));
+  auto aRe = vld1q_f32(src1);
+  auto aIm = vld1q_f32(src1 + half);
+  auto bRe = vld1q_f32(src2);
+  auto bIm = vld1q_f32(src2 + half);
+
+  vst1q_f32(result, vmlsq_f32(vmulq_f32(aRe, bRe), aIm, bIm));
+  vst1q_f32(result + half, vmlaq_f32(vmulq_f32(aRe, bIm), aIm, bRe));
+}
 
-  auto re = vmlsq_f32(vmulq_f32(a.val[0], b.val[0]), a.val[1], b.val[1]);
-  auto im = vmlaq_f32(vmulq_f32(a.val[0], b.val[1]), a.val[1], b.val[0]);
+inline void multiplyAdd(float* __restrict result,
+                        const float* __restrict src1,
+                        const float* __restrict src2,
+                        uint32_t half)
+{
+  auto aRe = vld1q_f32(src1);
+  auto aIm = vld1q_f32(src1 + half);
+  auto bRe = vld1q_f32(src2);
+  auto bIm = vld1q_f32(src2 + half);
+  auto sumRe = vld1q_f32(result);
+  auto sumIm = vld1q_f32(result + half);
 
-  vst2q_f32(reinterpret_cast<float* __restrict>(result), float32x4x2_t{re, im});
+  sumRe = vmlaq_f32(sumRe, aRe, bRe);
+  sumIm = vmlaq_f32(sumIm, aIm, bRe);
+  sumRe = vmlsq_f32(sumRe, aIm, bIm);
+  sumIm = vmlaq_f32(sumIm, aRe, bIm);
+
+  vst1q_f32(result, sumRe);
+  vst1q_f32(result + half, sumIm);
 }
 
-void multiplyAdd(std::complex<float>* __restrict result,
-                 const std::complex<float>* __restrict src1,
-                 const std::complex<float>* __restrict src2)
+inline void multiplyAccumulate(float* __restrict result,
+                               const float* __restrict src1,
+                               const float* __restrict src2,
+                               const float* __restrict sum,
+                               uint32_t half)
 {
-  auto a = vld2q_f32(reinterpret_cast<const float* __restrict>(src1));
-  auto b = vld2q_f32(reinterpret_cast<const float* __restrict>(src2));
-  auto sum = vld2q_f32(reinterpret_cast<const float* __restrict>(result));
+  auto aRe = vld1q_f32(src1);
+  auto aIm = vld1q_f32(src1 + half);
+  auto bRe = vld1q_f32(src2);
+  auto bIm = vld1q_f32(src2 + half);
+  auto sumRe = vld1q_f32(sum);
+  auto sumIm = vld1q_f32(sum + half);
 
-  sum.val[0] = vmlaq_f32(sum.val[0], a.val[0], b.val[0]);
-  sum.val[1] = vmlaq_f32(sum.val[1], a.val[1], b.val[0]);
-  sum.val[0] = vmlsq_f32(sum.val[0], a.val[1], b.val[1]);
-  sum.val[1] = vmlaq_f32(sum.val[1], a.val[0], b.val[1]);
+  sumRe = vmlaq_f32(sumRe, aRe, bRe);
+  sumIm = vmlaq_f32(sumIm, aIm, bRe);
+  sumRe = vmlsq_f32(sumRe, aIm, bIm);
+  sumIm = vmlaq_f32(sumIm, aRe, bIm);
 
-  vst2q_f32(reinterpret_cast<float* __restrict>(result), sum);
+  vst1q_f32(result, sumRe);
+  vst1q_f32(result + half, sumIm);
 }
 
-void add(std::complex<float>* __restrict result,
-         const std::complex<float>* __restrict src1,
-         const std::complex<float>* __restrict src2)
+// operates on re and im the same way => called with plain offsets
+inline void add(float* result, const float* src1, const float* src2)
 {
-  auto a = vld2q_f32(reinterpret_cast<const float* __restrict>(src1));
-  auto b = vld2q_f32(reinterpret_cast<const float* __restrict>(src2));
+  vst1q_f32(result, vaddq_f32(vld1q_f32(src1), vld1q_f32(src2)));
+}
 
-  vst2q_f32(reinterpret_cast<float* __restrict>(result),
-            float32x4x2_t{vaddq_f32(a.val[0], b.val[0]), vaddq_f32(a.val[1], b.val[1])});
+// 4 outputs of the time domain FIR: result[i] += sum of h[m] * x[i - m] over m < numTaps
+inline void fir(float* __restrict result,
+                const float* __restrict h,
+                const float* __restrict x,
+                uint32_t numTaps)
+{
+  auto sum = vld1q_f32(result);
+  for(uint32_t m{0}; m < numTaps; ++m)
+  {
+    sum = vmlaq_n_f32(sum, vld1q_f32(x - m), h[m]);
+  }
+  vst1q_f32(result, sum);
 }
 
-}  // namespace neon
\ No newline at end of file
+}  // namespace neon
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "../tasks/tasks.h"
+#include "convolution.h"
+#include "fft.h"
+#include "frequency_delay_line.h"
+
+// Non-uniform partitioned convolution:
+//   head: 3 partitions of inputBlockSize (B) handled by the uniform engine
+//   tail: segments of 2B, 4B, 8B, ... each starting at filter offset 2P - B
+//
+// A tail segment with partition size P collects P / B input blocks and spreads its work
+// (FFT, MACs, IFFT) over the next P / B blocks in the background tasks. The result is
+// needed exactly P / B blocks later, so the output is identical to the uniform engine.
+class NonUniformConvolution : public Convolution
+{
+public:
+  static constexpr uint32_t kNumHeadPartitions = 3;
+
+  struct SegmentLayout
+  {
+    uint32_t offset;
+    uint32_t size;
+    uint32_t partitionSize;
+  };
+
+  NonUniformConvolution(const std::span<const float>& h,
+                        uint32_t inputBlockSize,
+                        SpectrumCache* cache = nullptr)
+      : Convolution(
+            h.first(std::min<size_t>(h.size(), kNumHeadPartitions * inputBlockSize)), inputBlockSize, cache)
+  {
+    for(auto& [offset, size, partitionSize] : getSegmentLayout(h.size(), inputBlockSize))
+    {
+      segments_.push_back(
+          std::make_unique<Segment>(h.subspan(offset, size), partitionSize, inputBlockSize, cache));
+    }
+  }
+
+  // tail segments of a filter of filterSize taps
+  static std::vector<SegmentLayout> getSegmentLayout(uint32_t filterSize, uint32_t inputBlockSize)
+  {
+    std::vector<SegmentLayout> layout;
+
+    uint32_t offset = kNumHeadPartitions * inputBlockSize;
+    uint32_t partitionSize = 2 * inputBlockSize;
+
+    while(offset < filterSize)
+    {
+      uint32_t remaining = filterSize - offset;
+
+      // keep growing as long as next segment holds more than one partition
+      uint32_t numPartitions =
+          remaining > 4 * partitionSize ? 2 : (remaining + partitionSize - 1) / partitionSize;
+
+      layout.push_back({offset, std::min(remaining, numPartitions * partitionSize), partitionSize});
+
+      offset += numPartitions * partitionSize;
+      partitionSize *= 2;
+    }
+
+    return layout;
+  }
+
+  // FNV-1a over the layouts of the given filters => changes with the segmentation, checked by
+  // the spectrum cache as the spectra are stored segment by segment (see SpectrumCache::Key)
+  static uint64_t getLayoutHash(std::span<const uint32_t> filterSizes, uint32_t inputBlockSize)
+  {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto add = [&hash](uint32_t value) { hash = (hash ^ value) * 0x100000001b3ULL; };
+
+    add(kNumHeadPartitions);
+    for(auto filterSize : filterSizes)
+    {
+      for(auto& [offset, size, partitionSize] : getSegmentLayout(filterSize, inputBlockSize))
+      {
+        add(offset);
+        add(size);
+        add(partitionSize);
+      }
+    }
+
+    return hash;
+  }
+
+  std::tuple<std::vector<TaskType>, RealData> getOutputTasks(TaskType input,
+                                                             const RealData& inputBlock,
+                                                             uint32_t combineBlocks = 4)
+  {
+    return getMixTasks({{this, input, inputBlock}}, combineBlocks);
+  }
+
+  void clearDelayLine() override
+  {
+    Convolution::clearDelayLine();
+
+    for(auto& s : segments_)
+    {
+      s->clearDelayLine();
+    }
+  }
+
+  uint32_t getNumSegments() const { return segments_.size(); }
+
+protected:
+  // segments run in their own partition sizes => summed in time domain
+  std::vector<TaskType> getTailTasks(TaskType rootTask, TaskType input, const RealData& inputBlock) override
+  {
+    std::vector<TaskType> deps;
+    for(auto& s : segments_)
+    {
+      auto segment = s.get();
+      auto process = Task::create<uint32_t>([segment](Task& task) { segment->process(); }, {rootTask});
+      process->setLabel("segment process");
+
+      deps.push_back(Task::create<uint32_t>(
+          [segment, inputBlock](Task& task) { segment->feed(inputBlock.data()); }, {input, process}));
+      deps.back()->setLabel("segment feed");
+    }
+
+    return deps;
+  }
+
+  void addTail(RealData& output) const override
+  {
+    for(auto& s : segments_)
+    {
+      auto segment = s->getOutput();
+      for(uint32_t i{0}; i < output.size(); ++i)
+      {
+        output[i] += segment[i];
+      }
+    }
+  }
+
+  class Segment : public Convolution
+  {
+  public:
+    Segment(const std::span<const float>& h,
+            uint32_t partitionSize,
+            uint32_t inputBlockSize,
+            SpectrumCache* cache = nullptr)
+        : Convolution(h, partitionSize, cache),
+          inputBlockSize_{inputBlockSize},
+          numPhases_{partitionSize / inputBlockSize},
+          forwardFft_{fftSize_},
+          segmentDelayLine_{blockSize_, static_cast<uint32_t>(numBlocks_)}
+    {
+      delayLine_ = &segmentDelayLine_;
+      clearDelayLine();
+    }
+
+    // runs in foreground: append input block to the current frame
+    void feed(const float* block)
+    {
+      auto pos = (phase_ + numPhases_ - 1) % numPhases_;
+      memcpy(forwardFft_.input_.data() + subFilterSize_ + pos * inputBlockSize_,
+             block,
+             inputBlockSize_ * sizeof(float));
+    }
+
+    // runs in background: one slice of the work for the last complete frame
+    void process()
+    {
+      auto result = inverseFft_.input_.data();
+      auto current = forwardFft_.output_.data();
+
+      if(phase_ == 0)
+      {
+        forwardFft_.run();
+        memcpy(forwardFft_.input_.data(),
+               forwardFft_.input_.data() + subFilterSize_,
+               subFilterSize_ * sizeof(float));
+
+        multiply(result, H_, current, blockSize_);
+      }
+
+      // distribute remaining partitions evenly over all phases
+      auto first = 1 + (phase_ * (numBlocks_ - 1)) / numPhases_;
+      auto last = 1 + ((phase_ + 1) * (numBlocks_ - 1)) / numPhases_;
+      for(auto i{first}; i < last; ++i)
+      {
+        multiplyAdd(result, H_ + (blockSize_ * i), getBlock(i), blockSize_);
+      }
+
+      if(phase_ == numPhases_ - 1)
+      {
+        inverseFft_.run();
+        pushBlock(current);
+      }
+
+      phase_ = (phase_ + 1) % numPhases_;
+    }
+
+    // output for the current input block
+    const float* getOutput() const
+    {
+      return inverseFft_.output_.data() + subFilterSize_ + phase_ * inputBlockSize_;
+    }
+
+    void clearDelayLine() override
+    {
+      Convolution::clearDelayLine();
+
+      std::fill(forwardFft_.input_.begin(), forwardFft_.input_.end(), 0.0f);
+      std::fill(inverseFft_.input_.begin(), inverseFft_.input_.end(), 0.0f);
+      std::fill(inverseFft_.output_.begin(), inverseFft_.output_.end(), 0.0f);
+      phase_ = 0;
+    }
+
+  protected:
+    uint32_t inputBlockSize_;
+    uint32_t numPhases_;
+    uint32_t phase_{0};
+    ForwardFFT forwardFft_;
+    FrequencyDelayLine segmentDelayLine_;
+  };
+
+  std::vector<std::unique_ptr<Segment>> segments_;
+};
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "fft.h"
+
+// Binary cache of the partitioned filter spectra (H_ of every Convolution) and the filter
+// coefficients they were made from. The file is mapped read-only and the convolutions use
+// the spectra in place, so opening a stream neither parses the coeffs file nor runs the
+// per partition FFTs.
+//
+// File layout (all sections start cache line aligned):
+//   Header | filter sizes | filter coeffs (each padded) | spectra in construction order
+//
+// On a miss the convolutions compute their spectra as before and register them with
+// addSpectra; store writes everything to disk for the next start. Streams missing at the
+// same time each write a temp file of their own, the checksum over everything after the
+// header catches files that are damaged anyway.
+class SpectrumCache
+{
+public:
+  // hash of the segmentation of the filters, the sizes of a hit come from the cache
+  using LayoutHash = uint64_t (*)(std::span<const uint32_t> filterSizes, uint32_t blockSize);
+
+  struct Key
+  {
+    uint64_t coeffHash;
+    uint32_t blockSize;
+    uint32_t variant;   // e.g. partitioning
+    LayoutHash layout;  // e.g. NonUniformConvolution::getLayoutHash, nullptr => fixed layout
+  };
+
+  SpectrumCache(const std::string& path, const Key& key) : path_{path}, key_{key} { map(); }
+
+  SpectrumCache(const SpectrumCache&) = delete;
+  SpectrumCache& operator=(const SpectrumCache&) = delete;
+
+  ~SpectrumCache()
+  {
+    if(data_)
+    {
+      munmap(data_, dataSize_);
+    }
+  }
+
+  // FNV-1a over the raw file content
+  static uint64_t hashFile(const std::string& path)
+  {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> content{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(auto c : content)
+    {
+      hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+    }
+
+    return hash;
+  }
+
+  bool isHit() const { return data_ != nullptr; }
+
+  // filter coefficients of a hit
+  std::vector<std::span<const float>> getFilters() const { return filters_; }
+
+  // next spectra of size floats in construction order or nullptr if not cached
+  const float* getSpectra(uint32_t size)
+  {
+    if(!data_ || spectraOffset_ + size > spectraEnd_)
+    {
+      return nullptr;
+    }
+
+    auto spectra = reinterpret_cast<const float*>(data_) + spectraOffset_;
+    spectraOffset_ += size;
+    return spectra;
+  }
+
+  // computed spectra for store, must stay valid until then
+  void addSpectra(const float* spectra, uint32_t size) { newSpectra_.emplace_back(spectra, size); }
+
+  // write filters and all added spectra, replaces the file atomically
+  bool store(const std::vector<std::span<const float>>& filters) const
+  {
+    std::vector<uint32_t> sizes;
+    for(auto& f : filters)
+    {
+      sizes.push_back(f.size());
+    }
+
+    Header header{
+        kMagic, kVersion, key_.coeffHash, key_.blockSize, key_.variant, kSpectrumAlignment, getLayout(sizes)};
+    header.numFilters = filters.size();
+
+    for(auto& s : newSpectra_)
+    {
+      header.numSpectraFloats += s.size();
+    }
+
+    std::vector<uint8_t> payload;
+    append(payload, sizes.data(), sizes.size() * sizeof(uint32_t));
+
+    for(auto& f : filters)
+    {
+      append(payload, f.data(), f.size_bytes());
+    }
+
+    for(auto& s : newSpectra_)
+    {
+      append(payload, s.data(), s.size_bytes());
+    }
+
+    header.checksum = checksum(payload.data(), payload.size());
+
+    std::vector<uint8_t> file;
+    append(file, &header, sizeof(header));
+
+    // unique name => streams storing at the same time do not write into each other's file
+    std::string tmpPath = path_ + ".XXXXXX";
+    auto fd = mkstemp(tmpPath.data());
+    if(fd < 0)
+    {
+      return false;
+    }
+
+    bool written = fchmod(fd, 0644) == 0 && writeAll(fd, file.data(), file.size()) &&
+                   writeAll(fd, payload.data(), payload.size());
+
+    if(close(fd) != 0 || !written || std::rename(tmpPath.c_str(), path_.c_str()) != 0)
+    {
+      std::remove(tmpPath.c_str());
+      return false;
+    }
+
+    return true;
+  }
+
+protected:
+  static constexpr uint32_t kMagic = 0x534f5844;  // "DXOS"
+  static constexpr uint32_t kVersion = 4;  // 2: unscaled coefficients, 3: layout in the key, 4: checksum
+  static constexpr uint32_t kAlignment = 64;
+
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t coeffHash;
+    uint32_t blockSize;
+    uint32_t variant;
+    uint32_t spectrumAlignment;
+    uint64_t layout;
+    uint32_t numFilters{0};
+    uint64_t numSpectraFloats{0};
+    uint64_t checksum{0};  // of everything after the header
+  };
+
+  static uint64_t align(uint64_t offset) { return (offset + kAlignment - 1) & ~uint64_t(kAlignment - 1); }
+
+  // every section starts aligned => pad with zeros
+  static void append(std::vector<uint8_t>& out, const void* data, uint64_t size)
+  {
+    auto bytes = static_cast<const uint8_t*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+    out.resize(align(out.size()));
+  }
+
+  uint64_t getLayout(std::span<const uint32_t> filterSizes) const
+  {
+    return key_.layout ? key_.layout(filterSizes, key_.blockSize) : 0;
+  }
+
+  static bool writeAll(int fd, const uint8_t* data, uint64_t size)
+  {
+    while(size > 0)
+    {
+      auto n = ::write(fd, data, size);
+      if(n <= 0)
+      {
+        return false;
+      }
+
+      data += n;
+      size -= n;
+    }
+
+    return true;
+  }
+
+  // FNV-1a over 64 bit words, size is a multiple of kAlignment
+  static uint64_t checksum(const uint8_t* data, uint64_t size)
+  {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(uint64_t i{0}; i < size; i += sizeof(uint64_t))
+    {
+      uint64_t word;
+      std::memcpy(&word, data + i, sizeof(word));
+      hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+
+    return hash;
+  }
+
+  void map()
+  {
+    auto fd = open(path_.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+      return;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(Header)))
+    {
+      dataSize_ = st.st_size;
+      auto data = mmap(nullptr, dataSize_, PROT_READ, MAP_PRIVATE, fd, 0);
+      data_ = data != MAP_FAILED ? static_cast<uint8_t*>(data) : nullptr;
+    }
+
+    close(fd);
+
+    if(data_ && !parse())
+    {
+      munmap(data_, dataSize_);
+      data_ = nullptr;
+    }
+  }
+
+  bool parse()
+  {
+    auto header = reinterpret_cast<const Header*>(data_);
+    if(header->magic != kMagic || header->version != kVersion || header->coeffHash != key_.coeffHash ||
+       header->blockSize != key_.blockSize || header->variant != key_.variant ||
+       header->spectrumAlignment != kSpectrumAlignment)
+    {
+      return false;
+    }
+
+    auto payload = align(sizeof(Header));
+    if(dataSize_ < payload || (dataSize_ - payload) % kAlignment != 0 ||
+       checksum(data_ + payload, dataSize_ - payload) != header->checksum)
+    {
+      return false;
+    }
+
+    auto sizes = reinterpret_cast<const uint32_t*>(data_ + align(sizeof(Header)));
+    uint64_t offset = align(sizeof(Header)) + align(header->numFilters * sizeof(uint32_t));
+    if(offset > dataSize_ || header->layout != getLayout({sizes, header->numFilters}))
+    {
+      return false;
+    }
+
+    for(uint32_t i{0}; i < header->numFilters; ++i)
+    {
+      filters_.emplace_back(reinterpret_cast<const float*>(data_ + offset), sizes[i]);
+      offset += align(sizes[i] * sizeof(float));
+    }
+
+    spectraOffset_ = offset / sizeof(float);
+    spectraEnd_ = spectraOffset_ + header->numSpectraFloats;
+
+    return spectraEnd_ * sizeof(float) <= dataSize_;
+  }
+
+  std::string path_;
+  Key key_;
+  uint8_t* data_{nullptr};
+  uint64_t dataSize_{0};
+  uint64_t spectraOffset_{0};
+  uint64_t spectraEnd_{0};
+  std::vector<std::span<const float>> filters_;
+  std::vector<std::span<const float>> newSpectra_;
+};
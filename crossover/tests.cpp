@@ -4,10 +4,15 @@
 #include <algorithm>
 #include <chrono>
 #include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <vector>
 
 #include "convolution.h"
+#include "fft_wisdom.h"
 #include "fir_crossover.h"
+#include "non_uniform_convolution.h"
+#include "spectrum_cache.h"
 
 class FirFilterTest : public testing::Test
 {
@@ -106,6 +111,53 @@ TEST_F(FirFilterTest, Test_ParallelConvolution)
   }
 }
 
+TEST_F(FirFilterTest, Test_NonUniformConvolution)
+{
+  std::vector<float> h(301);
+  for(auto& r : h)
+  {
+    r = float((std::rand() % 1000) - 500) / 100;
+  }
+
+  std::vector<float> data(400);
+  for(auto& d : data)
+  {
+    d = float((std::rand() % 1000) - 500) / 100;
+  }
+  data.insert(data.end(), h.size() - 1, 0.0f);
+
+  for(auto blockSize : {2, 3, 4, 5, 8})
+  {
+    auto result_conv = convolve(h, data);
+
+    NonUniformConvolution filter(h, blockSize);
+    EXPECT_GT(filter.getNumSegments(), 2);
+
+    auto [inputJob, input] = Convolution::getInputTask(blockSize);
+    auto [rootJobs, output] = filter.getOutputTasks(inputJob, input, 1);
+
+    RealVec result_nupc;
+    uint32_t j = 0;
+    for(uint32_t k{0}; k < data.size() / blockSize; k++)
+    {
+      runner_.run(rootJobs, false);
+      for(auto& i : input)
+      {
+        i = data[j++];
+      }
+
+      runner_.run({inputJob});
+
+      for(auto f : output)
+      {
+        result_nupc.push_back(f);
+      }
+    }
+
+    EXPECT_TRUE(equals(result_nupc, result_conv)) << " blockSize " << blockSize;
+  }
+}
+
 TEST_F(FirFilterTest, Test_FirMultiChannelCrossover)
 {
   constexpr auto BlockSize = 120U;
@@ -178,6 +230,305 @@ TEST_F(FirFilterTest, Test_FirMultiChannelCrossover)
   }
 }
 
+TEST_F(FirFilterTest, Test_FirMultiChannelCrossoverMixedPartitioning)
+{
+  constexpr auto BlockSize = 32U;
+  constexpr auto NumBlocks = 80U;
+
+  std::vector<std::vector<float>> h;
+  for(size_t size : {1500, 700})
+  {
+    std::vector<float> rnd(size);
+    for(auto& r : rnd)
+    {
+      r = float((std::rand() % 1000) - 500) / 100;
+    }
+    h.push_back(rnd);
+  }
+
+  std::vector<float> input;
+  for(auto i{0}; i < BlockSize * NumBlocks; ++i)
+  {
+    input.push_back(float((std::rand() % 10000) - 5000) / 100);
+  }
+
+  std::vector<FirMultiChannelCrossover::ConfigType> config{
+      {0, h[0], FirMultiChannelCrossover::Partitioning::NonUniform},
+      {0, h[1], FirMultiChannelCrossover::Partitioning::Uniform}};
+
+  FirMultiChannelCrossover fmcc(BlockSize, 1, config, 3);
+
+  std::vector<std::vector<float>> outputs(config.size());
+  for(auto i{0}; i < NumBlocks; ++i)
+  {
+    std::copy_n(input.begin() + i * BlockSize, BlockSize, fmcc.getInputBuffer(0).begin());
+
+    fmcc.updateInputs();
+
+    for(auto j{0}; j < outputs.size(); ++j)
+    {
+      auto output = fmcc.getOutputBuffer(j);
+      outputs[j].insert(outputs[j].end(), output.begin(), output.end());
+    }
+  }
+
+  for(auto i{0U}; i < h.size(); ++i)
+  {
+    auto conv = convolve(h[i], input);
+    EXPECT_TRUE(equals(std::span(conv).subspan(0, BlockSize * NumBlocks), outputs[i]));
+  }
+}
+
+TEST_F(FirFilterTest, Test_FirMultiChannelCrossoverStaticSchedule)
+{
+  constexpr auto BlockSize = 32U;
+  constexpr auto NumBlocks = 60U;
+
+  std::vector<std::vector<float>> h;
+  for(size_t size : {1100, 700, 90})
+  {
+    std::vector<float> rnd(size);
+    for(auto& r : rnd)
+    {
+      r = float((std::rand() % 1000) - 500) / 100;
+    }
+    h.push_back(rnd);
+  }
+
+  std::vector<float> input;
+  for(auto i{0}; i < BlockSize * NumBlocks; ++i)
+  {
+    input.push_back(float((std::rand() % 10000) - 5000) / 100);
+  }
+
+  std::vector<FirMultiChannelCrossover::ConfigType> config{
+      {0, h[0], FirMultiChannelCrossover::Partitioning::NonUniform},
+      {0, h[1], FirMultiChannelCrossover::Partitioning::Uniform},
+      {0, h[2], FirMultiChannelCrossover::Partitioning::Uniform}};
+
+  FirMultiChannelCrossover fmcc(BlockSize, 1, config, 3);
+  fmcc.compileSchedule(4);
+
+  std::vector<std::vector<float>> outputs(config.size());
+  for(auto i{0}; i < NumBlocks; ++i)
+  {
+    std::copy_n(input.begin() + i * BlockSize, BlockSize, fmcc.getInputBuffer(0).begin());
+
+    fmcc.updateInputs();
+
+    for(auto j{0}; j < outputs.size(); ++j)
+    {
+      auto output = fmcc.getOutputBuffer(j);
+      outputs[j].insert(outputs[j].end(), output.begin(), output.end());
+    }
+  }
+
+  for(auto i{0U}; i < h.size(); ++i)
+  {
+    auto conv = convolve(h[i], input);
+    EXPECT_TRUE(equals(std::span(conv).subspan(0, BlockSize * NumBlocks), outputs[i])) << " filter " << i;
+  }
+}
+
+TEST_F(FirFilterTest, Test_FirMultiChannelCrossoverSummedOutputs)
+{
+  constexpr auto BlockSize = 32U;
+  constexpr auto NumBlocks = 60U;
+  constexpr auto NumInputs = 2U;
+
+  std::vector<std::vector<float>> h;
+  for(size_t size : {900, 300, 500, 70})
+  {
+    std::vector<float> rnd(size);
+    for(auto& r : rnd)
+    {
+      r = float((std::rand() % 1000) - 500) / 100;
+    }
+    h.push_back(rnd);
+  }
+
+  std::vector<std::vector<float>> inputs(NumInputs);
+  for(auto& ch : inputs)
+  {
+    for(auto i{0}; i < BlockSize * NumBlocks; ++i)
+    {
+      ch.push_back(float((std::rand() % 10000) - 5000) / 100);
+    }
+  }
+
+  // L + R into output 7, a correction filter on top of L into output 3, R alone
+  std::vector<FirMultiChannelCrossover::ConfigType> config{
+      {0, h[0], FirMultiChannelCrossover::Partitioning::NonUniform, 7},
+      {0, h[1], FirMultiChannelCrossover::Partitioning::Uniform, 3},
+      {1, h[2], FirMultiChannelCrossover::Partitioning::NonUniform, 7},
+      {0, h[3], FirMultiChannelCrossover::Partitioning::Uniform, 3},
+      {1, h[3]}};
+
+  for(auto [staticSchedule, batchedFft] :
+      {std::pair{false, false}, std::pair{true, false}, std::pair{false, true}, std::pair{true, true}})
+  {
+    FirMultiChannelCrossover fmcc(BlockSize, NumInputs, config, 2, nullptr, batchedFft);
+    if(staticSchedule)
+    {
+      fmcc.compileSchedule(4);
+    }
+
+    std::vector<std::vector<float>> outputs(3);
+    for(auto i{0}; i < NumBlocks; ++i)
+    {
+      for(auto j{0}; j < NumInputs; ++j)
+      {
+        std::copy_n(inputs[j].begin() + i * BlockSize, BlockSize, fmcc.getInputBuffer(j).begin());
+      }
+
+      fmcc.updateInputs();
+
+      for(auto j{0}; j < outputs.size(); ++j)
+      {
+        auto output = fmcc.getOutputBuffer(j);
+        outputs[j].insert(outputs[j].end(), output.begin(), output.end());
+      }
+    }
+
+    auto sum = [this, &h, &inputs](uint32_t filter1, uint32_t input1, uint32_t filter2, uint32_t input2) {
+      auto a = convolve(h[filter1], inputs[input1]);
+      auto b = convolve(h[filter2], inputs[input2]);
+      for(auto i{0}; i < a.size(); ++i)
+      {
+        a[i] += b[i];
+      }
+      return a;
+    };
+
+    auto sub = sum(0, 0, 2, 1);
+    EXPECT_TRUE(equals(std::span(sub).subspan(0, BlockSize * NumBlocks), outputs[0]));
+
+    auto corrected = sum(1, 0, 3, 0);
+    EXPECT_TRUE(equals(std::span(corrected).subspan(0, BlockSize * NumBlocks), outputs[1]));
+
+    auto conv = convolve(h[3], inputs[1]);
+    EXPECT_TRUE(equals(std::span(conv).subspan(0, BlockSize * NumBlocks), outputs[2])) << batchedFft;
+  }
+}
+
+TEST_F(FirFilterTest, Test_FirMultiChannelCrossoverBatchedFft)
+{
+  constexpr auto BlockSize = 64U;
+  constexpr auto NumBlocks = 40U;
+  constexpr auto NumInputs = 3U;
+
+  std::vector<float> h(1000);
+  for(auto& r : h)
+  {
+    r = float((std::rand() % 1000) - 500) / 100;
+  }
+
+  std::vector<FirMultiChannelCrossover::ConfigType> config;
+  for(auto i{0U}; i < 7; ++i)
+  {
+    config.push_back({i % NumInputs, std::span(h).first(200 + 100 * i)});
+  }
+
+  auto getOutputs = [&](bool batchedFft) {
+    FirMultiChannelCrossover fmcc(BlockSize, NumInputs, config, 3, nullptr, batchedFft);
+
+    std::vector<float> outputs;
+    for(auto i{0}; i < NumBlocks; ++i)
+    {
+      for(auto j{0}; j < NumInputs; ++j)
+      {
+        std::fill(fmcc.getInputBuffer(j).begin(), fmcc.getInputBuffer(j).end(), float((i + j) % 7) - 3);
+      }
+      fmcc.updateInputs();
+
+      for(auto j{0}; j < config.size(); ++j)
+      {
+        auto output = fmcc.getOutputBuffer(j);
+        outputs.insert(outputs.end(), output.begin(), output.end());
+      }
+    }
+
+    return outputs;
+  };
+
+  auto batched = getOutputs(true);
+  auto expected = getOutputs(false);
+  EXPECT_TRUE(equals(batched, expected));
+}
+
+TEST_F(FirFilterTest, Test_FirMultiChannelCrossoverZeroLatency)
+{
+  constexpr auto BlockSize = 32U;
+  constexpr auto NumBlocks = 50U;
+
+  std::vector<std::vector<float>> h;
+  for(size_t size : {900, 300, 20})
+  {
+    std::vector<float> rnd(size);
+    for(auto& r : rnd)
+    {
+      r = float((std::rand() % 1000) - 500) / 100;
+    }
+    h.push_back(rnd);
+  }
+
+  std::vector<std::vector<float>> inputs(2);
+  for(auto& ch : inputs)
+  {
+    for(auto i{0}; i < BlockSize * NumBlocks; ++i)
+    {
+      ch.push_back(float((std::rand() % 10000) - 5000) / 100);
+    }
+  }
+
+  // shorter than a block => head only
+  std::vector<FirMultiChannelCrossover::ConfigType> config{
+      {0, h[0], FirMultiChannelCrossover::Partitioning::NonUniform, 0},
+      {1, h[1], FirMultiChannelCrossover::Partitioning::Uniform, 0},
+      {1, h[2]}};
+
+  FirMultiChannelCrossover fmcc(BlockSize, 2, config, 3, nullptr, false, true);
+  EXPECT_TRUE(fmcc.isZeroLatency());
+
+  // sub-blocks of varying size, each output is available right after its input
+  std::vector<std::vector<float>> outputs(2);
+  for(uint32_t pos{0}, offset{0}; pos < BlockSize * NumBlocks;)
+  {
+    uint32_t frames = std::min<uint32_t>(1 + std::rand() % 13, BlockSize - offset);
+    for(auto j{0}; j < inputs.size(); ++j)
+    {
+      std::copy_n(inputs[j].begin() + pos, frames, fmcc.getInputBuffer(j).begin() + offset);
+    }
+
+    fmcc.processHead(offset, frames);
+
+    for(auto j{0}; j < outputs.size(); ++j)
+    {
+      auto output = fmcc.getOutputBuffer(j).subspan(offset, frames);
+      outputs[j].insert(outputs[j].end(), output.begin(), output.end());
+    }
+
+    pos += frames;
+    offset += frames;
+    if(offset == BlockSize)
+    {
+      fmcc.updateInputs();
+      offset = 0;
+    }
+  }
+
+  auto sum = convolve(h[0], inputs[0]);
+  auto other = convolve(h[1], inputs[1]);
+  for(auto i{0}; i < sum.size(); ++i)
+  {
+    sum[i] += other[i];
+  }
+  EXPECT_TRUE(equals(std::span(sum).subspan(0, BlockSize * NumBlocks), outputs[0]));
+
+  auto conv = convolve(h[2], inputs[1]);
+  EXPECT_TRUE(equals(std::span(conv).subspan(0, BlockSize * NumBlocks), outputs[1]));
+}
+
 TEST_F(FirFilterTest, Test_ResetFilterState)
 {
   constexpr auto BlockSize = 4U;
@@ -205,4 +556,129 @@ TEST_F(FirFilterTest, Test_ResetFilterState)
 
   EXPECT_TRUE(equals(kZeros, fmcc.getOutputBuffer(0)));
   EXPECT_TRUE(equals(kZeros, fmcc.getOutputBuffer(1)));
-}
\ No newline at end of file
+}
+
+TEST_F(FirFilterTest, Test_SpectrumCache)
+{
+  constexpr auto BlockSize = 32U;
+  constexpr auto NumBlocks = 40U;
+  const auto path = std::filesystem::temp_directory_path() / "dxo_test.spectra";
+  std::filesystem::remove(path);
+
+  std::vector<std::vector<float>> h;
+  for(size_t size : {1000, 300})
+  {
+    std::vector<float> rnd(size);
+    for(auto& r : rnd)
+    {
+      r = float((std::rand() % 1000) - 500) / 100;
+    }
+    h.push_back(rnd);
+  }
+
+  std::vector<std::span<const float>> filters(h.begin(), h.end());
+  SpectrumCache::Key key{0x1234, BlockSize, 1, &NonUniformConvolution::getLayoutHash};
+
+  auto getOutputs = [&](const std::vector<std::span<const float>>& filters,
+                        std::shared_ptr<SpectrumCache> cache) {
+    std::vector<FirMultiChannelCrossover::ConfigType> config{
+        {0, filters[0], FirMultiChannelCrossover::Partitioning::NonUniform},
+        {0, filters[1], FirMultiChannelCrossover::Partitioning::Uniform}};
+
+    FirMultiChannelCrossover fmcc(BlockSize, 1, config, 3, cache);
+
+    // spectra are owned by the convolutions => store while they exist
+    if(!cache->isHit())
+    {
+      EXPECT_TRUE(cache->store(filters));
+    }
+
+    std::vector<float> outputs;
+    for(auto i{0}; i < NumBlocks; ++i)
+    {
+      std::fill(fmcc.getInputBuffer(0).begin(), fmcc.getInputBuffer(0).end(), float(i % 7) - 3);
+      fmcc.updateInputs();
+
+      for(auto j{0}; j < config.size(); ++j)
+      {
+        auto output = fmcc.getOutputBuffer(j);
+        outputs.insert(outputs.end(), output.begin(), output.end());
+      }
+    }
+
+    return outputs;
+  };
+
+  auto miss = std::make_shared<SpectrumCache>(path, key);
+  EXPECT_FALSE(miss->isHit());
+  auto expected = getOutputs(filters, miss);
+
+  auto hit = std::make_shared<SpectrumCache>(path, key);
+  ASSERT_TRUE(hit->isHit());
+  ASSERT_EQ(hit->getFilters().size(), filters.size());
+  EXPECT_TRUE(std::equal(filters[1].begin(), filters[1].end(), hit->getFilters()[1].begin()));
+  auto outputs = getOutputs(hit->getFilters(), hit);
+  EXPECT_TRUE(equals(outputs, expected));
+
+  EXPECT_FALSE(SpectrumCache(path, {0x1234, 2 * BlockSize, 1, key.layout}).isHit());
+  EXPECT_FALSE(SpectrumCache(path, {0x4321, BlockSize, 1, key.layout}).isHit());
+  EXPECT_FALSE(SpectrumCache(path, {0x1234, BlockSize, 1, nullptr}).isHit());
+
+  // other segmentation of the cached filter sizes
+  auto otherLayout = [](std::span<const uint32_t> sizes, uint32_t blockSize) -> uint64_t {
+    return NonUniformConvolution::getLayoutHash(sizes, blockSize) + 1;
+  };
+  EXPECT_FALSE(SpectrumCache(path, {0x1234, BlockSize, 1, otherLayout}).isHit());
+
+  std::vector<uint32_t> sizes{1000, 300};
+  std::vector<uint32_t> longer{4000, 300};
+  EXPECT_NE(NonUniformConvolution::getLayoutHash(sizes, BlockSize),
+            NonUniformConvolution::getLayoutHash(sizes, 64));
+  EXPECT_NE(NonUniformConvolution::getLayoutHash(sizes, BlockSize),
+            NonUniformConvolution::getLayoutHash(longer, BlockSize));
+
+  // right header, damaged spectra (e.g. written by two streams at once)
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(-4, std::ios::end);
+    file.put(0x7f);
+  }
+  EXPECT_FALSE(SpectrumCache(path, key).isHit());
+
+  std::filesystem::remove(path);
+}
+
+TEST_F(FirFilterTest, Test_FftWisdom)
+{
+  const auto path = std::filesystem::temp_directory_path() / "dxo_test.wisdom";
+  std::filesystem::remove(path);
+  fftwf_forget_wisdom();
+
+  {
+    FftWisdom wisdom{path};
+    FftWisdom::plan({120, 2000, 3, 5, 2}, FFTW_MEASURE);
+    EXPECT_TRUE(wisdom.store());
+  }
+
+  // plans must come from the file only
+  fftwf_forget_wisdom();
+  FftWisdom wisdom{path};
+
+  EXPECT_EQ(FftWisdom::getFftSizes(120, 2000), (std::vector<uint32_t>{240, 480, 960}));
+  for(auto fftSize : FftWisdom::getFftSizes(120, 2000))
+  {
+    ForwardFFT forward{fftSize, FFTW_MEASURE | FFTW_WISDOM_ONLY};
+    BackwardFFT backward{fftSize, FFTW_MEASURE | FFTW_WISDOM_ONLY};
+    EXPECT_NE(forward.plan_, nullptr);
+    EXPECT_NE(backward.plan_, nullptr);
+  }
+
+  // batches of 5 outputs on 2 threads, measured plans would add wisdom
+  EXPECT_EQ(FirMultiChannelCrossover::getBatchSizes(5, 2), (std::vector<uint32_t>{2, 3}));
+  BatchedForwardFFT forward{240, 3, FFTW_MEASURE};
+  BatchedBackwardFFT backward2{240, 2, FFTW_MEASURE};
+  BatchedBackwardFFT backward3{240, 3, FFTW_MEASURE};
+  EXPECT_FALSE(wisdom.hasNewWisdom());
+
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <immintrin.h>
+#include <stdint.h>
+
+namespace x86
+{
+
+// All kernels work on split complex spectra: real parts in [0, half), imaginary parts in
+// [half, 2 * half). Spectra are cache line aligned and half is a multiple of 16 (see
+// getSpectrumSize), so every loop runs on whole aligned registers without a tail.
+
+namespace sse2
+{
+
+inline void multiply(float* __restrict result,
+                     const float* __restrict src1,
+                     const float* __restrict src2,
+                     uint32_t half)
+{
+  for(uint32_t i{0}; i < half; i += 4)
+  {
+    auto aRe = _mm_load_ps(src1 + i);
+    auto aIm = _mm_load_ps(src1 + half + i);
+    auto bRe = _mm_load_ps(src2 + i);
+    auto bIm = _mm_load_ps(src2 + half + i);
+
+    _mm_store_ps(result + i, _mm_sub_ps(_mm_mul_ps(aRe, bRe), _mm_mul_ps(aIm, bIm)));
+    _mm_store_ps(result + half + i, _mm_add_ps(_mm_mul_ps(aRe, bIm), _mm_mul_ps(aIm, bRe)));
+  }
+}
+
+inline void multiplyAdd(float* __restrict result,
+                        const float* __restrict src1,
+                        const float* __restrict src2,
+                        uint32_t half)
+{
+  for(uint32_t i{0}; i < half; i += 4)
+  {
+    auto aRe = _mm_load_ps(src1 + i);
+    auto aIm = _mm_load_ps(src1 + half + i);
+    auto bRe = _mm_load_ps(src2 + i);
+    auto bIm = _mm_load_ps(src2 + half + i);
+    auto re = _mm_sub_ps(_mm_mul_ps(aRe, bRe), _mm_mul_ps(aIm, bIm));
+    auto im = _mm_add_ps(_mm_mul_ps(aRe, bIm), _mm_mul_ps(aIm, bRe));
+
+    _mm_store_ps(result + i, _mm_add_ps(_mm_load_ps(result + i), re));
+    _mm_store_ps(result + half + i, _mm_add_ps(_mm_load_ps(result + half + i), im));
+  }
+}
+
+inline void multiplyAccumulate(float* __restrict result,
+                               const float* __restrict src1,
+                               const float* __restrict src2,
+                               const float* __restrict sum,
+                               uint32_t half)
+{
+  for(uint32_t i{0}; i < half; i += 4)
+  {
+    auto aRe = _mm_load_ps(src1 + i);
+    auto aIm = _mm_load_ps(src1 + half + i);
+    auto bRe = _mm_load_ps(src2 + i);
+    auto bIm = _mm_load_ps(src2 + half + i);
+    auto re = _mm_sub_ps(_mm_mul_ps(aRe, bRe), _mm_mul_ps(aIm, bIm));
+    auto im = _mm_add_ps(_mm_mul_ps(aRe, bIm), _mm_mul_ps(aIm, bRe));
+
+    _mm_store_ps(result + i, _mm_add_ps(_mm_load_ps(sum + i), re));
+    _mm_store_ps(result + half + i, _mm_add_ps(_mm_load_ps(sum + half + i), im));
+  }
+}
+
+// size is the number of floats, result may be the same as src1
+inline void add(float* result, const float* src1, const float* src2, uint32_t size)
+{
+  for(uint32_t i{0}; i < size; i += 4)
+  {
+    _mm_store_ps(result + i, _mm_add_ps(_mm_load_ps(src1 + i), _mm_load_ps(src2 + i)));
+  }
+}
+
+// time domain FIR (zero latency head): result[i] += sum of h[m] * x[i - m] over m < numTaps,
+// x holds numTaps - 1 samples of history before x[0]. Unaligned, any frames.
+inline void fir(float* __restrict result,
+                const float* __restrict h,
+                const float* __restrict x,
+                uint32_t numTaps,
+                uint32_t frames)
+{
+  uint32_t i{0};
+
+  // 4 independent sums hide the add latency
+  for(; i + 16 <= frames; i += 16)
+  {
+    __m128 sum[4];
+    for(uint32_t k{0}; k < 4; ++k)
+    {
+      sum[k] = _mm_loadu_ps(result + i + 4 * k);
+    }
+
+    for(uint32_t m{0}; m < numTaps; ++m)
+    {
+      auto coeff = _mm_set1_ps(h[m]);
+      for(uint32_t k{0}; k < 4; ++k)
+      {
+        sum[k] = _mm_add_ps(sum[k], _mm_mul_ps(coeff, _mm_loadu_ps(x + i + 4 * k - m)));
+      }
+    }
+
+    for(uint32_t k{0}; k < 4; ++k)
+    {
+      _mm_storeu_ps(result + i + 4 * k, sum[k]);
+    }
+  }
+
+  for(; i + 4 <= frames; i += 4)
+  {
+    auto sum = _mm_loadu_ps(result + i);
+    for(uint32_t m{0}; m < numTaps; ++m)
+    {
+      sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(h[m]), _mm_loadu_ps(x + i - m)));
+    }
+    _mm_storeu_ps(result + i, sum);
+  }
+
+  for(; i < frames; ++i)
+  {
+    for(uint32_t m{0}; m < numTaps; ++m)
+    {
+      result[i] += h[m] * *(x + i - m);
+    }
+  }
+}
+
+}  // namespace sse2
+
+namespace avx2
+{
+
+__attribute__((target("avx2,fma")))
+inline void multiply(float* __restrict result,
+                     const float* __restrict src1,
+                     const float* __restrict src2,
+                     uint32_t half)
+{
+  for(uint32_t i{0}; i < half; i += 8)
+  {
+    auto aRe = _mm256_load_ps(src1 + i);
+    auto aIm = _mm256_load_ps(src1 + half + i);
+    auto bRe = _mm256_load_ps(src2 + i);
+    auto bIm = _mm256_load_ps(src2 + half + i);
+
+    _mm256_store_ps(result + i, _mm256_fmsub_ps(aRe, bRe, _mm256_mul_ps(aIm, bIm)));
+    _mm256_store_ps(result + half + i, _mm256_fmadd_ps(aRe, bIm, _mm256_mul_ps(aIm, bRe)));
+  }
+}
+
+__attribute__((target("avx2,fma")))
+inline void multiplyAdd(float* __restrict result,
+                        const float* __restrict src1,
+                        const float* __restrict src2,
+                        uint32_t half)
+{
+  for(uint32_t i{0}; i < half; i += 8)
+  {
+    auto aRe = _mm256_load_ps(src1 + i);
+    auto aIm = _mm256_load_ps(src1 + half + i);
+    auto bRe = _mm256_load_ps(src2 + i);
+    auto bIm = _mm256_load_ps(src2 + half + i);
+    auto re = _mm256_fmadd_ps(aRe, bRe, _mm256_load_ps(result + i));
+    auto im = _mm256_fmadd_ps(aRe, bIm, _mm256_load_ps(result + half + i));
+
+    _mm256_store_ps(result + i, _mm256_fnmadd_ps(aIm, bIm, re));
+    _mm256_store_ps(result + half + i, _mm256_fmadd_ps(aIm, bRe, im));
+  }
+}
+
+__attribute__((target("avx2,fma")))
+inline void multiplyAccumulate(float* __restrict result,
+                               const float* __restrict src1,
+                               const float* __restrict src2,
+                               const float* __restrict sum,
+                               uint32_t half)
+{
+  for(uint32_t i{0}; i < half; i += 8)
+  {
+    auto aRe = _mm256_load_ps(src1 + i);
+    auto aIm = _mm256_load_ps(src1 + half + i);
+    auto bRe = _mm256_load_ps(src2 + i);
+    auto bIm = _mm256_load_ps(src2 + half + i);
+    auto re = _mm256_fmadd_ps(aRe, bRe, _mm256_load_ps(sum + i));
+    auto im = _mm256_fmadd_ps(aRe, bIm, _mm256_load_ps(sum + half + i));
+
+    _mm256_store_ps(result + i, _mm256_fnmadd_ps(aIm, bIm, re));
+    _mm256_store_ps(result + half + i, _mm256_fmadd_ps(aIm, bRe, im));
+  }
+}
+
+__attribute__((target("avx2,fma")))
+inline void add(float* result, const float* src1, const float* src2, uint32_t size)
+{
+  for(uint32_t i{0}; i < size; i += 8)
+  {
+    _mm256_store_ps(result + i, _mm256_add_ps(_mm256_load_ps(src1 + i), _mm256_load_ps(src2 + i)));
+  }
+}
+
+__attribute__((target("avx2,fma")))
+inline void fir(float* __restrict result,
+                const float* __restrict h,
+                const float* __restrict x,
+                uint32_t numTaps,
+                uint32_t frames)
+{
+  uint32_t i{0};
+
+  for(; i + 32 <= frames; i += 32)
+  {
+    __m256 sum[4];
+    for(uint32_t k{0}; k < 4; ++k)
+    {
+      sum[k] = _mm256_loadu_ps(result + i + 8 * k);
+    }
+
+    for(uint32_t m{0}; m < numTaps; ++m)
+    {
+      auto coeff = _mm256_set1_ps(h[m]);
+      for(uint32_t k{0}; k < 4; ++k)
+      {
+        sum[k] = _mm256_fmadd_ps(coeff, _mm256_loadu_ps(x + i + 8 * k - m), sum[k]);
+      }
+    }
+
+    for(uint32_t k{0}; k < 4; ++k)
+    {
+      _mm256_storeu_ps(result + i + 8 * k, sum[k]);
+    }
+  }
+
+  for(; i + 8 <= frames; i += 8)
+  {
+    auto sum = _mm256_loadu_ps(result + i);
+    for(uint32_t m{0}; m < numTaps; ++m)
+    {
+      sum = _mm256_fmadd_ps(_mm256_set1_ps(h[m]), _mm256_loadu_ps(x + i - m), sum);
+    }
+    _mm256_storeu_ps(result + i, sum);
+  }
+
+  sse2::fir(result + i, h, x + i, numTaps, frames - i);
+}
+
+}  // namespace avx2
+
+struct Kernels
+{
+  void (*multiply)(float*, const float*, const float*, uint32_t);
+  void (*multiplyAdd)(float*, const float*, const float*, uint32_t);
+  void (*multiplyAccumulate)(float*, const float*, const float*, const float*, uint32_t);
+  void (*add)(float*, const float*, const float*, uint32_t);
+  void (*fir)(float*, const float*, const float*, uint32_t, uint32_t);
+};
+
+inline constexpr Kernels kSse2Kernels{
+    sse2::multiply, sse2::multiplyAdd, sse2::multiplyAccumulate, sse2::add, sse2::fir};
+inline constexpr Kernels kAvx2Kernels{
+    avx2::multiply, avx2::multiplyAdd, avx2::multiplyAccumulate, avx2::add, avx2::fir};
+
+inline bool hasAvx2()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+// selected once at startup by the cpu we run on
+inline const Kernels& getKernels()
+{
+  static const Kernels& kernels = hasAvx2() ? kAvx2Kernels : kSse2Kernels;
+  return kernels;
+}
+
+}  // namespace x86
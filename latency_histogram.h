@@ -0,0 +1,134 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+
+// Log scale histogram of durations: 4 buckets per octave of nanoseconds (<= 25% bucket width)
+// from exact values below 8 ns up to ~8 s.
+//
+// record() is wait and allocation free for a single writer (the audio thread), any thread may
+// take a snapshot while it runs. Counters are read one by one => a snapshot can be off by the
+// recording in flight.
+class LatencyHistogram
+{
+public:
+  static constexpr uint32_t kSubBuckets = 4;
+  static constexpr uint32_t kNumBuckets = 32 * kSubBuckets;
+
+  struct Snapshot
+  {
+    std::array<uint64_t, kNumBuckets> buckets{};
+    uint64_t count{0};
+    uint64_t sumNs{0};
+    uint64_t maxNs{0};
+
+    double meanNs() const { return count > 0 ? static_cast<double>(sumNs) / count : 0.0; }
+
+    // upper bound of the bucket holding quantile q (0..1], never above max
+    uint64_t percentileNs(double q) const
+    {
+      uint64_t total{0};
+      for(auto n : buckets)
+      {
+        total += n;
+      }
+
+      auto rank = static_cast<uint64_t>(std::ceil(q * total));
+      uint64_t seen{0};
+      for(uint32_t i{0}; i < kNumBuckets; ++i)
+      {
+        seen += buckets[i];
+        if(seen >= std::max<uint64_t>(rank, 1))
+        {
+          return std::min(getUpperBound(i), maxNs);
+        }
+      }
+
+      return maxNs;
+    }
+  };
+
+  // single writer only
+  void record(std::chrono::nanoseconds duration)
+  {
+    auto ns = static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0));
+
+    increment(buckets_[getBucket(ns)], 1);
+    increment(count_, 1);
+    increment(sumNs_, ns);
+
+    if(ns > maxNs_.load(std::memory_order_relaxed))
+    {
+      maxNs_.store(ns, std::memory_order_relaxed);
+    }
+  }
+
+  Snapshot getSnapshot() const
+  {
+    Snapshot snapshot;
+    for(uint32_t i{0}; i < kNumBuckets; ++i)
+    {
+      snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    snapshot.count = count_.load(std::memory_order_relaxed);
+    snapshot.sumNs = sumNs_.load(std::memory_order_relaxed);
+    snapshot.maxNs = maxNs_.load(std::memory_order_relaxed);
+    return snapshot;
+  }
+
+  // writer must not be active
+  void reset()
+  {
+    for(auto& b : buckets_)
+    {
+      b.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sumNs_.store(0, std::memory_order_relaxed);
+    maxNs_.store(0, std::memory_order_relaxed);
+  }
+
+  // octave of the leading bit, the next two bits select the sub bucket
+  static uint32_t getBucket(uint64_t ns)
+  {
+    if(ns < 2 * kSubBuckets)
+    {
+      return ns;
+    }
+
+    uint32_t octave = std::bit_width(ns) - 1;
+    uint32_t sub = (ns >> (octave - 2)) & (kSubBuckets - 1);
+    return std::min((octave - 1) * kSubBuckets + sub, kNumBuckets - 1);
+  }
+
+  // largest duration falling into bucket i
+  static uint64_t getUpperBound(uint32_t i)
+  {
+    if(i < 2 * kSubBuckets)
+    {
+      return i;
+    }
+
+    uint32_t octave = i / kSubBuckets + 1;
+    uint64_t sub = i % kSubBuckets;
+    return ((kSubBuckets + sub + 1) << (octave - 2)) - 1;
+  }
+
+protected:
+  // plain load and store, no locked instruction on the audio thread
+  static void increment(std::atomic<uint64_t>& counter, uint64_t value)
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<uint64_t>, kNumBuckets> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sumNs_{0};
+  std::atomic<uint64_t> maxNs_{0};
+};
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "latency_histogram.h"
+
+using namespace std::chrono_literals;
+
+TEST(LatencyHistogramTest, Test_Buckets)
+{
+  // contiguous and monotonic, every value lands in the bucket whose bounds enclose it
+  uint64_t lower{0};
+  for(uint32_t i{0}; i < LatencyHistogram::kNumBuckets - 1; ++i)
+  {
+    auto upper = LatencyHistogram::getUpperBound(i);
+    EXPECT_EQ(LatencyHistogram::getBucket(lower), i);
+    EXPECT_EQ(LatencyHistogram::getBucket(upper), i);
+    EXPECT_LE(upper - lower, lower / 4 + 1);
+    lower = upper + 1;
+  }
+
+  EXPECT_EQ(LatencyHistogram::getBucket(~0ULL), LatencyHistogram::kNumBuckets - 1);
+}
+
+TEST(LatencyHistogramTest, Test_Percentiles)
+{
+  LatencyHistogram histogram;
+
+  // 980 fast blocks, 19 slow ones and a single spike
+  for(uint32_t i{0}; i < 980; ++i)
+  {
+    histogram.record(100us);
+  }
+  for(uint32_t i{0}; i < 19; ++i)
+  {
+    histogram.record(2ms);
+  }
+  histogram.record(10ms);
+
+  auto snapshot = histogram.getSnapshot();
+  EXPECT_EQ(snapshot.count, 1000);
+  EXPECT_EQ(snapshot.maxNs, 10'000'000);
+  EXPECT_NEAR(snapshot.meanNs(), (980 * 100e3 + 19 * 2e6 + 10e6) / 1000, 1.0);
+
+  auto p50 = snapshot.percentileNs(0.5);
+  EXPECT_GE(p50, 100'000);
+  EXPECT_LE(p50, 125'000);
+
+  auto p99 = snapshot.percentileNs(0.99);
+  EXPECT_GE(p99, 2'000'000);
+  EXPECT_LE(p99, 2'500'000);
+
+  EXPECT_EQ(snapshot.percentileNs(1.0), 10'000'000);
+
+  histogram.reset();
+  snapshot = histogram.getSnapshot();
+  EXPECT_EQ(snapshot.count, 0);
+  EXPECT_EQ(snapshot.percentileNs(0.99), 0);
+
+  // clock going backwards => 0
+  histogram.record(-1ns);
+  EXPECT_EQ(histogram.getSnapshot().buckets[0], 1);
+}
+
+TEST(LatencyHistogramTest, Test_LiveSnapshot)
+{
+  LatencyHistogram histogram;
+  std::atomic<bool> done{false};
+  constexpr uint32_t kCount = 1000000;
+
+  std::thread writer([&] {
+    for(uint32_t i{0}; i < kCount; ++i)
+    {
+      histogram.record(std::chrono::nanoseconds(i % 5000));
+    }
+    done = true;
+  });
+
+  // counts never go backwards while the writer runs
+  uint64_t last{0};
+  while(!done)
+  {
+    auto snapshot = histogram.getSnapshot();
+    EXPECT_GE(snapshot.count, last);
+    EXPECT_LT(snapshot.maxNs, 5000);
+    last = snapshot.count;
+  }
+  writer.join();
+
+  EXPECT_EQ(histogram.getSnapshot().count, kCount);
+}
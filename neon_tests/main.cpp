@@ -6,67 +6,95 @@
 
 #include "../crossover/neon.h"
 
-static void multiply(std::complex<float>* result,
-                     const std::complex<float>* src1,
-                     const std::complex<float>* src2)
+// 4 split complex bins: real parts [0, 4), imaginary parts [4, 8)
+static constexpr uint32_t kHalf = 4;
+
+static std::complex<float> get(const float* data, uint32_t i)
+{
+  return {data[i], data[i + kHalf]};
+}
+
+static void set(float* data, uint32_t i, std::complex<float> value)
 {
-  auto s1 = src1;
-  auto s2 = src2;
-  auto r = result;
-  auto rend = result + 4;
+  data[i] = value.real();
+  data[i + kHalf] = value.imag();
+}
 
-  while(r < rend)
+static void multiply(float* result, const float* src1, const float* src2)
+{
+  for(uint32_t i{0}; i < kHalf; ++i)
   {
-    *r++ = *s1++ * *s2++;
+    set(result, i, get(src1, i) * get(src2, i));
   }
 }
 
-static void multiplyAdd(std::complex<float>* result,
-                        const std::complex<float>* src1,
-                        const std::complex<float>* src2)
+static void multiplyAdd(float* result, const float* src1, const float* src2)
 {
-  auto s1 = src1;
-  auto s2 = src2;
-  auto r = result;
-  auto rend = result + 4;
+  for(uint32_t i{0}; i < kHalf; ++i)
+  {
+    set(result, i, get(result, i) + get(src1, i) * get(src2, i));
+  }
+}
 
-  while(r < rend)
+static void multiplyAccumulate(float* result, const float* src1, const float* src2, const float* sum)
+{
+  for(uint32_t i{0}; i < kHalf; ++i)
   {
-    *r++ += *s1++ * *s2++;
+    set(result, i, get(src1, i) * get(src2, i) + get(sum, i));
   }
 }
 
-static void add(std::complex<float>* result, const std::complex<float>* src1, const std::complex<float>* src2)
+static void add(float* result, const float* src1, const float* src2)
 {
-  auto s1 = src1;
-  auto s2 = src2;
-  auto r = result;
-  auto rend = result + 4;
+  for(uint32_t i{0}; i < 2 * kHalf; ++i)
+  {
+    result[i] = src1[i] + src2[i];
+  }
+}
 
-  while(r < rend)
+static void fir(float* result, const float* h, const float* x, uint32_t numTaps)
+{
+  for(uint32_t i{0}; i < 4; ++i)
   {
-    *r++ = *s1++ + *s2++;
+    for(uint32_t m{0}; m < numTaps; ++m)
+    {
+      result[i] += h[m] * *(x + i - m);
+    }
   }
 }
 
 int main()
 {
-  std::complex<float> a[4] = {{1, 10}, {2, 11}, {3, 12}, {4, 13}};
-  std::complex<float> b[4] = {{5, 14}, {6, 15}, {7, 16}, {8, 17}};
-  std::vector<std::complex<float>> result{{0, 0}, {0, 0}, {0, 0}, {0, 0}};
-  std::vector<std::complex<float>> result_neon{{0, 0}, {0, 0}, {0, 0}, {0, 0}};
+  float a[8] = {1, 2, 3, 4, 10, 11, 12, 13};
+  float b[8] = {5, 6, 7, 8, 14, 15, 16, 17};
+  float c[8] = {-3, 9, 0, 5, 2, -4, 1, 5};
+  std::vector<float> result(8, 0.0f);
+  std::vector<float> result_neon(8, 0.0f);
 
   neon::add(result_neon.data(), a, b);
+  neon::add(result_neon.data() + 4, a + 4, b + 4);
   add(result.data(), a, b);
   const bool addEqual = result_neon == result;
 
-  neon::multiply(result_neon.data(), a, b);
+  neon::multiply(result_neon.data(), a, b, kHalf);
   multiply(result.data(), a, b);
   const bool multiplyEqual = result_neon == result;
 
-  neon::multiplyAdd(result_neon.data(), a, b);
+  neon::multiplyAdd(result_neon.data(), a, b, kHalf);
   multiplyAdd(result.data(), a, b);
   const bool multiplyAddEqual = result_neon == result;
 
-  return (addEqual && multiplyEqual && multiplyAddEqual) ? 0 : -1;
+  neon::multiplyAccumulate(result_neon.data(), a, b, c, kHalf);
+  multiplyAccumulate(result.data(), a, b, c);
+  const bool multiplyAccumulateEqual = result_neon == result;
+
+  // 3 taps => x starts after 2 samples of history, integer values => exact
+  float h[3] = {2, -1, 3};
+  std::vector<float> fir_result(4, 1.0f);
+  std::vector<float> fir_result_neon(4, 1.0f);
+  neon::fir(fir_result_neon.data(), h, c + 2, 3);
+  fir(fir_result.data(), h, c + 2, 3);
+  const bool firEqual = fir_result_neon == fir_result;
+
+  return (addEqual && multiplyEqual && multiplyAddEqual && multiplyAccumulateEqual && firEqual) ? 0 : -1;
 }
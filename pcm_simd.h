@@ -0,0 +1,415 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <cstring>
+
+// Interleave kernels of PcmStream for the common layouts: 2 or 3 input channels (stereo,
+// stereo + LFE) and 8 output channels. Every call converts 4 frames. Integer samples are
+// scaled to full scale +-1.0f on input, on output they are scaled back, rounded and
+// saturated (int32 kernels take scale and max of the format, e.g. 2^23 for 24 bit).
+
+#if defined(BUILD_X86)
+
+#include <immintrin.h>
+
+namespace x86::pcm
+{
+
+// sse2 only: the kernels are bound by loads and shuffles, wider registers gain nothing
+inline void toFloat(__m128i samples, __m128& lo, __m128& hi)
+{
+  auto scale = _mm_set1_ps(1.0f / 32768);
+  lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16)), scale);
+  hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16)), scale);
+}
+
+inline void deinterleave(__m128 v0, __m128 v1, float* a, float* b)
+{
+  _mm_storeu_ps(a, _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0)));
+  _mm_storeu_ps(b, _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+// v0 = a0 b0 c0 a1, v1 = b1 c1 a2 b2, v2 = c2 a3 b3 c3
+inline void deinterleave(__m128 v0, __m128 v1, __m128 v2, float* a, float* b, float* c)
+{
+  auto a23 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 0, 3, 2));
+  _mm_storeu_ps(a, _mm_shuffle_ps(v0, a23, _MM_SHUFFLE(3, 0, 3, 0)));
+
+  auto b01 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 1, 1));
+  auto b23 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 2, 3, 3));
+  _mm_storeu_ps(b, _mm_shuffle_ps(b01, b23, _MM_SHUFFLE(2, 0, 2, 0)));
+
+  auto c01 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 1, 2, 2));
+  auto c23 = _mm_shuffle_ps(v2, v2, _MM_SHUFFLE(3, 3, 0, 0));
+  _mm_storeu_ps(c, _mm_shuffle_ps(c01, c23, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+inline void deinterleave(const int16_t* src, float* a, float* b)
+{
+  __m128 v0, v1;
+  toFloat(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), v0, v1);
+  deinterleave(v0, v1, a, b);
+}
+
+inline void deinterleave(const float* src, float* a, float* b)
+{
+  deinterleave(_mm_loadu_ps(src), _mm_loadu_ps(src + 4), a, b);
+}
+
+inline void deinterleave(const int16_t* src, float* a, float* b, float* c)
+{
+  __m128 v0, v1, v2, unused;
+  toFloat(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), v0, v1);
+  toFloat(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + 8)), v2, unused);
+  deinterleave(v0, v1, v2, a, b, c);
+}
+
+inline void deinterleave(const float* src, float* a, float* b, float* c)
+{
+  deinterleave(_mm_loadu_ps(src), _mm_loadu_ps(src + 4), _mm_loadu_ps(src + 8), a, b, c);
+}
+
+// cvtps rounds to nearest, values beyond the int32 range would convert to INT_MIN
+inline __m128i toInt32(const float* src, float scale, float max)
+{
+  auto x = _mm_mul_ps(_mm_loadu_ps(src), _mm_set1_ps(scale));
+  return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-scale)), _mm_set1_ps(max)));
+}
+
+// a0 b0 a1 b1 a2 b2 a3 b3
+inline __m128i toInt16Pairs(const float* a, const float* b)
+{
+  auto ia = toInt32(a, 32768.0f, 32767.0f);
+  auto ib = toInt32(b, 32768.0f, 32767.0f);
+  return _mm_unpacklo_epi16(_mm_packs_epi32(ia, ia), _mm_packs_epi32(ib, ib));
+}
+
+// v<i> holds 4 samples (32 bit) of channel i => 4 frames of 8 channels
+inline void storeFrames(float* dst,
+                        __m128 v0,
+                        __m128 v1,
+                        __m128 v2,
+                        __m128 v3,
+                        __m128 v4,
+                        __m128 v5,
+                        __m128 v6,
+                        __m128 v7)
+{
+  _MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+  _MM_TRANSPOSE4_PS(v4, v5, v6, v7);
+
+  _mm_storeu_ps(dst, v0);
+  _mm_storeu_ps(dst + 4, v4);
+  _mm_storeu_ps(dst + 8, v1);
+  _mm_storeu_ps(dst + 12, v5);
+  _mm_storeu_ps(dst + 16, v2);
+  _mm_storeu_ps(dst + 20, v6);
+  _mm_storeu_ps(dst + 24, v3);
+  _mm_storeu_ps(dst + 28, v7);
+}
+
+inline void interleave(int16_t* dst,
+                       const float* c0,
+                       const float* c1,
+                       const float* c2,
+                       const float* c3,
+                       const float* c4,
+                       const float* c5,
+                       const float* c6,
+                       const float* c7)
+{
+  auto p01 = toInt16Pairs(c0, c1);
+  auto p23 = toInt16Pairs(c2, c3);
+  auto p45 = toInt16Pairs(c4, c5);
+  auto p67 = toInt16Pairs(c6, c7);
+
+  // 4x4 transpose of the 32 bit channel pairs
+  auto lo0 = _mm_unpacklo_epi32(p01, p23);
+  auto hi0 = _mm_unpackhi_epi32(p01, p23);
+  auto lo1 = _mm_unpacklo_epi32(p45, p67);
+  auto hi1 = _mm_unpackhi_epi32(p45, p67);
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi64(lo0, lo1));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 8), _mm_unpackhi_epi64(lo0, lo1));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpacklo_epi64(hi0, hi1));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 24), _mm_unpackhi_epi64(hi0, hi1));
+}
+
+inline void interleave(float* dst,
+                       const float* c0,
+                       const float* c1,
+                       const float* c2,
+                       const float* c3,
+                       const float* c4,
+                       const float* c5,
+                       const float* c6,
+                       const float* c7)
+{
+  storeFrames(dst,
+              _mm_loadu_ps(c0),
+              _mm_loadu_ps(c1),
+              _mm_loadu_ps(c2),
+              _mm_loadu_ps(c3),
+              _mm_loadu_ps(c4),
+              _mm_loadu_ps(c5),
+              _mm_loadu_ps(c6),
+              _mm_loadu_ps(c7));
+}
+
+inline void interleave(int32_t* dst,
+                       float scale,
+                       float max,
+                       const float* c0,
+                       const float* c1,
+                       const float* c2,
+                       const float* c3,
+                       const float* c4,
+                       const float* c5,
+                       const float* c6,
+                       const float* c7)
+{
+  auto load = [scale, max](const float* src) { return _mm_castsi128_ps(toInt32(src, scale, max)); };
+  storeFrames(reinterpret_cast<float*>(dst),
+              load(c0),
+              load(c1),
+              load(c2),
+              load(c3),
+              load(c4),
+              load(c5),
+              load(c6),
+              load(c7));
+}
+
+// 4 samples of 24 bit packed into the low 12 bytes
+inline __m128i pack24(__m128i samples)
+{
+  auto lo = _mm_and_si128(samples, _mm_set1_epi64x(0x0000000000ffffff));
+  auto hi = _mm_and_si128(_mm_srli_epi64(samples, 8), _mm_set1_epi64x(0x0000ffffff000000));
+  auto pairs = _mm_or_si128(lo, hi);  // 6 bytes per 64 bit lane
+
+  return _mm_or_si128(_mm_move_epi64(pairs), _mm_slli_si128(_mm_srli_si128(pairs, 8), 6));
+}
+
+// S24_3LE, each 16 byte store is overlapped by the next one except for the last
+inline void interleave24(uint8_t* dst,
+                         const float* c0,
+                         const float* c1,
+                         const float* c2,
+                         const float* c3,
+                         const float* c4,
+                         const float* c5,
+                         const float* c6,
+                         const float* c7)
+{
+  auto load = [](const float* src) { return _mm_castsi128_ps(toInt32(src, 8388608.0f, 8388607.0f)); };
+  __m128 v[8]{load(c0), load(c1), load(c2), load(c3), load(c4), load(c5), load(c6), load(c7)};
+  _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+  _MM_TRANSPOSE4_PS(v[4], v[5], v[6], v[7]);
+
+  for(uint32_t i{0}; i < 7; ++i)
+  {
+    auto packed = pack24(_mm_castps_si128(v[i / 2 + 4 * (i % 2)]));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 12 * i), packed);
+  }
+
+  auto packed = pack24(_mm_castps_si128(v[7]));
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 84), packed);
+  int32_t last = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+  std::memcpy(dst + 92, &last, 4);
+}
+
+}  // namespace x86::pcm
+
+namespace pcm_simd
+{
+using namespace x86::pcm;
+}
+
+#elif defined(BUILD_ARM)
+
+#include <arm_neon.h>
+
+namespace neon::pcm
+{
+
+inline float32x4_t toFloat(int16x4_t samples)
+{
+  return vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(samples)), 1.0f / 32768);
+}
+
+// vcvt truncates and saturates => add +-0.5 to round to nearest
+inline int32x4_t toInt32(const float* src, float scale, float max)
+{
+  auto x = vmulq_n_f32(vld1q_f32(src), scale);
+  auto half = vbslq_f32(vcltq_f32(x, vdupq_n_f32(0.0f)), vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f));
+  x = vminq_f32(vmaxq_f32(vaddq_f32(x, half), vdupq_n_f32(-scale)), vdupq_n_f32(max));
+  return vcvtq_s32_f32(x);
+}
+
+inline int16x4_t toInt16(const float* src)
+{
+  return vmovn_s32(toInt32(src, 32768.0f, 32767.0f));
+}
+
+// v<i> holds 4 samples (32 bit) of channel i => 4 frames of 8 channels
+inline void storeFrames(float* dst,
+                        float32x4_t v0,
+                        float32x4_t v1,
+                        float32x4_t v2,
+                        float32x4_t v3,
+                        float32x4_t v4,
+                        float32x4_t v5,
+                        float32x4_t v6,
+                        float32x4_t v7)
+{
+  auto transpose = [](float32x4_t a, float32x4_t b, float32x4_t c, float32x4_t d) {
+    auto ac = vzipq_f32(a, c);
+    auto bd = vzipq_f32(b, d);
+    auto lo = vzipq_f32(ac.val[0], bd.val[0]);
+    auto hi = vzipq_f32(ac.val[1], bd.val[1]);
+    return float32x4x4_t{{lo.val[0], lo.val[1], hi.val[0], hi.val[1]}};
+  };
+
+  auto lo = transpose(v0, v1, v2, v3);
+  auto hi = transpose(v4, v5, v6, v7);
+  for(uint32_t i{0}; i < 4; ++i)
+  {
+    vst1q_f32(dst + 8 * i, lo.val[i]);
+    vst1q_f32(dst + 8 * i + 4, hi.val[i]);
+  }
+}
+
+inline void deinterleave(const int16_t* src, float* a, float* b)
+{
+  auto v = vld2_s16(src);
+  vst1q_f32(a, toFloat(v.val[0]));
+  vst1q_f32(b, toFloat(v.val[1]));
+}
+
+inline void deinterleave(const float* src, float* a, float* b)
+{
+  auto v = vld2q_f32(src);
+  vst1q_f32(a, v.val[0]);
+  vst1q_f32(b, v.val[1]);
+}
+
+inline void deinterleave(const int16_t* src, float* a, float* b, float* c)
+{
+  auto v = vld3_s16(src);
+  vst1q_f32(a, toFloat(v.val[0]));
+  vst1q_f32(b, toFloat(v.val[1]));
+  vst1q_f32(c, toFloat(v.val[2]));
+}
+
+inline void deinterleave(const float* src, float* a, float* b, float* c)
+{
+  auto v = vld3q_f32(src);
+  vst1q_f32(a, v.val[0]);
+  vst1q_f32(b, v.val[1]);
+  vst1q_f32(c, v.val[2]);
+}
+
+inline void interleave(int16_t* dst,
+                       const float* c0,
+                       const float* c1,
+                       const float* c2,
+                       const float* c3,
+                       const float* c4,
+                       const float* c5,
+                       const float* c6,
+                       const float* c7)
+{
+  // channel pairs per frame, then frames of 4 channels
+  auto p01 = vzip_s16(toInt16(c0), toInt16(c1));
+  auto p23 = vzip_s16(toInt16(c2), toInt16(c3));
+  auto p45 = vzip_s16(toInt16(c4), toInt16(c5));
+  auto p67 = vzip_s16(toInt16(c6), toInt16(c7));
+
+  for(uint32_t i{0}; i < 2; ++i)
+  {
+    auto lo = vzip_s32(vreinterpret_s32_s16(p01.val[i]), vreinterpret_s32_s16(p23.val[i]));
+    auto hi = vzip_s32(vreinterpret_s32_s16(p45.val[i]), vreinterpret_s32_s16(p67.val[i]));
+
+    vst1_s16(dst + 16 * i, vreinterpret_s16_s32(lo.val[0]));
+    vst1_s16(dst + 16 * i + 4, vreinterpret_s16_s32(hi.val[0]));
+    vst1_s16(dst + 16 * i + 8, vreinterpret_s16_s32(lo.val[1]));
+    vst1_s16(dst + 16 * i + 12, vreinterpret_s16_s32(hi.val[1]));
+  }
+}
+
+inline void interleave(float* dst,
+                       const float* c0,
+                       const float* c1,
+                       const float* c2,
+                       const float* c3,
+                       const float* c4,
+                       const float* c5,
+                       const float* c6,
+                       const float* c7)
+{
+  storeFrames(dst,
+              vld1q_f32(c0),
+              vld1q_f32(c1),
+              vld1q_f32(c2),
+              vld1q_f32(c3),
+              vld1q_f32(c4),
+              vld1q_f32(c5),
+              vld1q_f32(c6),
+              vld1q_f32(c7));
+}
+
+inline void interleave(int32_t* dst,
+                       float scale,
+                       float max,
+                       const float* c0,
+                       const float* c1,
+                       const float* c2,
+                       const float* c3,
+                       const float* c4,
+                       const float* c5,
+                       const float* c6,
+                       const float* c7)
+{
+  auto load = [scale, max](const float* src) { return vreinterpretq_f32_s32(toInt32(src, scale, max)); };
+  storeFrames(reinterpret_cast<float*>(dst),
+              load(c0),
+              load(c1),
+              load(c2),
+              load(c3),
+              load(c4),
+              load(c5),
+              load(c6),
+              load(c7));
+}
+
+// S24_3LE, samples are packed by overlapping 4 byte stores (little endian, the next store
+// overwrites the sign byte), the last one is cut to 3
+inline void interleave24(uint8_t* dst,
+                         const float* c0,
+                         const float* c1,
+                         const float* c2,
+                         const float* c3,
+                         const float* c4,
+                         const float* c5,
+                         const float* c6,
+                         const float* c7)
+{
+  alignas(16) int32_t frames[32];
+  interleave(frames, 8388608.0f, 8388607.0f, c0, c1, c2, c3, c4, c5, c6, c7);
+
+  for(uint32_t i{0}; i < 31; ++i)
+  {
+    std::memcpy(dst + 3 * i, frames + i, 4);
+  }
+  std::memcpy(dst + 3 * 31, frames + 31, 3);
+}
+
+}  // namespace neon::pcm
+
+namespace pcm_simd
+{
+using namespace neon::pcm;
+}
+
+#endif
@@ -4,12 +4,39 @@
 #include <alsa/pcm_external.h>
 #include <stdint.h>
 
+#include <algorithm>
 #include <cmath>
 #include <initializer_list>
 #include <memory>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "pcm_simd.h"
+
+// sample layouts of the 24/32 bit slave formats (int16_t => S16_LE, float => FLOAT_LE),
+// stored from floats of full scale +-1.0f
+struct SampleS32  // S32_LE
+{
+  static constexpr float kScale = 2147483648.0f;
+  static constexpr float kMax = 2147483520.0f;  // largest float below 2^31
+
+  int32_t value;
+};
+
+struct SampleS24  // S24_LE, low 3 bytes of 4 sign extended
+{
+  static constexpr float kScale = 8388608.0f;
+  static constexpr float kMax = 8388607.0f;
+
+  int32_t value;
+};
+
+struct SampleS24Packed  // S24_3LE
+{
+  uint8_t bytes[3];
+};
+
 template <typename DstType, typename SrcType>
 inline DstType convert(SrcType sample)
 {
@@ -19,7 +46,45 @@ inline DstType convert(SrcType sample)
 template <>
 inline float convert<float, int16_t>(int16_t sample)
 {
-  return std::ldexp(static_cast<float>(sample), -15);
+  return static_cast<float>(sample) * (1.0f / 32768);
+}
+
+// float => integer formats round to nearest and saturate, a bare cast wraps around on overload
+template <>
+inline int16_t convert<int16_t, float>(float sample)
+{
+  return static_cast<int16_t>(std::lrint(std::clamp(sample * 32768.0f, -32768.0f, 32767.0f)));
+}
+
+template <>
+inline SampleS32 convert<SampleS32, float>(float sample)
+{
+  using S = SampleS32;
+  return {static_cast<int32_t>(std::lrint(std::clamp(sample * S::kScale, -S::kScale, S::kMax)))};
+}
+
+template <>
+inline SampleS24 convert<SampleS24, float>(float sample)
+{
+  using S = SampleS24;
+  return {static_cast<int32_t>(std::lrint(std::clamp(sample * S::kScale, -S::kScale, S::kMax)))};
+}
+
+template <>
+inline SampleS24Packed convert<SampleS24Packed, float>(float sample)
+{
+  auto value = convert<SampleS24>(sample).value;
+  return {{static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value >> 16)}};
+}
+
+// calls f(std::integral_constant<uint32_t, count>{}) for 1 <= count <= kMaxCount => channel
+// counts known at run time select kernels generated for exactly that count
+template <uint32_t kMaxCount, typename Function>
+inline void withChannelCount(uint32_t count, const Function& f)
+{
+  [&]<uint32_t... kCounts>(std::integer_sequence<uint32_t, kCounts...>) {
+    ((count == kCounts + 1 ? (f(std::integral_constant<uint32_t, kCounts + 1>{}), true) : false) || ...);
+  }(std::make_integer_sequence<uint32_t, kMaxCount>{});
 }
 
 template <typename DstType, typename SrcType>
@@ -60,6 +125,18 @@ public:
     auto* src = addr_;
     auto* srcMax = src + calculateOffset(size);
 
+#if defined(BUILD_X86) || defined(BUILD_ARM)
+    if constexpr((std::is_same_v<SampleType, int16_t> || std::is_same_v<SampleType, float>) &&
+                 hasSimd<kNumArgs == 2 || kNumArgs == 3, Args...>())
+    {
+      for(; step_ == kNumArgs && src + 4 * kNumArgs <= srcMax; src += 4 * kNumArgs)
+      {
+        pcm_simd::deinterleave(src, args...);
+        ((args += 4), ...);
+      }
+    }
+#endif
+
     while(src < srcMax)
     {
       ((*args++ = convert<std::remove_reference_t<decltype(*args)>>(*src++)), ...);
@@ -77,6 +154,17 @@ public:
     auto* dst = addr_;
     auto* dstMax = dst + calculateOffset(size);
 
+#if defined(BUILD_X86) || defined(BUILD_ARM)
+    if constexpr(kHasStoreKernel && hasSimd<kNumArgs == 8, Args...>())
+    {
+      for(; step_ == kNumArgs && dst + 4 * kNumArgs <= dstMax; dst += 4 * kNumArgs)
+      {
+        interleave(dst, args...);
+        ((args += 4), ...);
+      }
+    }
+#endif
+
     while(dst < dstMax)
     {
       ((*dst++ = convert<std::remove_reference_t<decltype(*dst)>>(*args++)), ...);
@@ -86,7 +174,56 @@ public:
     addr_ = dst;
   }
 
+  // channels[0..kNumChannels) + offset
+  template <uint32_t kNumChannels, typename ChannelType>
+  void extractChannels(uint32_t size, ChannelType* const* channels, uint32_t offset)
+  {
+    [&]<size_t... kIndex>(std::index_sequence<kIndex...>) {
+      extractInterleaved(size, (channels[kIndex] + offset)...);
+    }(std::make_index_sequence<kNumChannels>{});
+  }
+
+  template <uint32_t kNumChannels, typename ChannelType>
+  void loadChannels(uint32_t size, ChannelType* const* channels, uint32_t offset)
+  {
+    [&]<size_t... kIndex>(std::index_sequence<kIndex...>) {
+      loadInterleaved(size, (channels[kIndex] + offset)...);
+    }(std::make_index_sequence<kNumChannels>{});
+  }
+
 protected:
+  static constexpr bool kHasStoreKernel =
+      std::is_same_v<SampleType, int16_t> || std::is_same_v<SampleType, float> ||
+      std::is_same_v<SampleType, SampleS32> || std::is_same_v<SampleType, SampleS24> ||
+      std::is_same_v<SampleType, SampleS24Packed>;
+
+  // kernels of pcm_simd.h take float channels, other channel types go the scalar way
+  template <bool kLayout, typename... Args>
+  static constexpr bool hasSimd()
+  {
+    return kLayout && (std::is_same_v<std::remove_cvref_t<decltype(*std::declval<Args>())>, float> && ...);
+  }
+
+#if defined(BUILD_X86) || defined(BUILD_ARM)
+  // 4 frames of 8 channels in the slave format
+  template <typename... Args>
+  static void interleave(SampleType* dst, Args... args)
+  {
+    if constexpr(std::is_same_v<SampleType, int16_t> || std::is_same_v<SampleType, float>)
+    {
+      pcm_simd::interleave(dst, args...);
+    }
+    else if constexpr(std::is_same_v<SampleType, SampleS32> || std::is_same_v<SampleType, SampleS24>)
+    {
+      pcm_simd::interleave(reinterpret_cast<int32_t*>(dst), SampleType::kScale, SampleType::kMax, args...);
+    }
+    else
+    {
+      pcm_simd::interleave24(reinterpret_cast<uint8_t*>(dst), args...);
+    }
+  }
+#endif
+
   uint32_t calculateOffset(uint32_t offset) { return step_ * offset; }
 
   SampleType* addr_;
@@ -0,0 +1,106 @@
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "pcm_stream.h"
+
+// stereo (+ LFE) client frames into the crossover inputs, kSimd = false is the plain
+// per sample loop for comparison
+template <typename SampleType, bool kSimd>
+static void BM_ExtractInterleaved(benchmark::State& state)
+{
+  const uint32_t frames = state.range(0);
+  const uint32_t numChannels = state.range(1);
+
+  std::vector<SampleType> interleaved(frames * numChannels, SampleType{1});
+  std::vector<float> a(frames), b(frames), c(frames);
+
+  for(auto _ : state)
+  {
+    if constexpr(kSimd)
+    {
+      PcmStream<SampleType> src(interleaved.data(), numChannels);
+      if(numChannels == 2)
+      {
+        src.extractInterleaved(frames, a.data(), b.data());
+      }
+      else
+      {
+        src.extractInterleaved(frames, a.data(), b.data(), c.data());
+      }
+    }
+    else
+    {
+      for(uint32_t i{0}; i < frames; ++i)
+      {
+        a[i] = convert<float>(interleaved[i * numChannels]);
+        b[i] = convert<float>(interleaved[i * numChannels + 1]);
+        if(numChannels == 3)
+        {
+          c[i] = convert<float>(interleaved[i * numChannels + 2]);
+        }
+      }
+    }
+    benchmark::DoNotOptimize(a.data());
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations() * frames);
+}
+
+BENCHMARK(BM_ExtractInterleaved<int16_t, false>)->ArgsProduct({{256, 1024}, {2, 3}});
+BENCHMARK(BM_ExtractInterleaved<int16_t, true>)->ArgsProduct({{256, 1024}, {2, 3}});
+BENCHMARK(BM_ExtractInterleaved<float, false>)->ArgsProduct({{256, 1024}, {2, 3}});
+BENCHMARK(BM_ExtractInterleaved<float, true>)->ArgsProduct({{256, 1024}, {2, 3}});
+
+// crossover outputs into 8 channel frames of each slave format
+template <typename SampleType, bool kSimd>
+static void BM_LoadInterleaved(benchmark::State& state)
+{
+  const uint32_t frames = state.range(0);
+
+  std::vector<SampleType> interleaved(frames * 8);
+  std::vector<std::vector<float>> ch(8, std::vector<float>(frames, 0.3f));
+
+  for(auto _ : state)
+  {
+    if constexpr(kSimd)
+    {
+      PcmStream<SampleType> dst(interleaved.data(), 8);
+      dst.loadInterleaved(frames,
+                          ch[0].data(),
+                          ch[1].data(),
+                          ch[2].data(),
+                          ch[3].data(),
+                          ch[4].data(),
+                          ch[5].data(),
+                          ch[6].data(),
+                          ch[7].data());
+    }
+    else
+    {
+      for(uint32_t i{0}; i < frames; ++i)
+      {
+        for(uint32_t c{0}; c < 8; ++c)
+        {
+          interleaved[i * 8 + c] = convert<SampleType>(ch[c][i]);
+        }
+      }
+    }
+    benchmark::DoNotOptimize(interleaved.data());
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations() * frames);
+}
+
+BENCHMARK(BM_LoadInterleaved<int16_t, false>)->Arg(256)->Arg(1024);
+BENCHMARK(BM_LoadInterleaved<int16_t, true>)->Arg(256)->Arg(1024);
+BENCHMARK(BM_LoadInterleaved<SampleS32, false>)->Arg(256)->Arg(1024);
+BENCHMARK(BM_LoadInterleaved<SampleS32, true>)->Arg(256)->Arg(1024);
+BENCHMARK(BM_LoadInterleaved<SampleS24, true>)->Arg(256)->Arg(1024);
+BENCHMARK(BM_LoadInterleaved<SampleS24Packed, false>)->Arg(256)->Arg(1024);
+BENCHMARK(BM_LoadInterleaved<SampleS24Packed, true>)->Arg(256)->Arg(1024);
+BENCHMARK(BM_LoadInterleaved<float, false>)->Arg(256)->Arg(1024);
+BENCHMARK(BM_LoadInterleaved<float, true>)->Arg(256)->Arg(1024);
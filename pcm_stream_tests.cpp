@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 
+#include <cstring>
+#include <limits>
+
 #include "pcm_stream.h"
 
 class PcmStreamTest : public testing::Test
@@ -138,3 +141,111 @@ TEST_F(PcmStreamTest, Test_PcmBuffer)
     EXPECT_TRUE(equal) << " at block " << (i);
   }
 }
+
+TEST_F(PcmStreamTest, Test_InterleavedExtractSimd)
+{
+  constexpr uint32_t kFrames = 23;  // 5 vector rounds + scalar tail
+
+  auto check = [](auto* interleaved, uint32_t numChannels) {
+    std::vector<std::vector<float>> channels(3, std::vector<float>(kFrames));
+    PcmStream stream(interleaved, numChannels);
+    if(numChannels == 2)
+    {
+      stream.extractInterleaved(kFrames, channels[0].data(), channels[1].data());
+    }
+    else
+    {
+      stream.extractInterleaved(kFrames, channels[0].data(), channels[1].data(), channels[2].data());
+    }
+
+    for(uint32_t c{0}; c < numChannels; ++c)
+    {
+      for(uint32_t i{0}; i < kFrames; ++i)
+      {
+        EXPECT_EQ(channels[c][i], convert<float>(interleaved[i * numChannels + c])) << c << " " << i;
+      }
+    }
+  };
+
+  for(uint32_t numChannels : {2U, 3U})
+  {
+    std::vector<int16_t> s16(kFrames * numChannels);
+    std::vector<float> f32(kFrames * numChannels);
+    for(uint32_t i{0}; i < s16.size(); ++i)
+    {
+      s16[i] = static_cast<int16_t>(i * 2731 - 32768);
+      f32[i] = 0.01f * i - 0.5f;
+    }
+
+    check(s16.data(), numChannels);
+    check(f32.data(), numChannels);
+  }
+}
+
+TEST_F(PcmStreamTest, Test_InterleavedLoadFormats)
+{
+  constexpr uint32_t kFrames = 11;  // 2 vector rounds + scalar tail
+
+  float channels[8][kFrames];
+  for(uint32_t c{0}; c < 8; ++c)
+  {
+    for(uint32_t i{0}; i < kFrames; ++i)
+    {
+      channels[c][i] = (c * kFrames + i) / 40.0f - 1.1f + 1e-4f;
+    }
+  }
+  channels[3][1] = 1e10f;
+  channels[4][2] = -1e10f;
+
+  // kernels and the scalar conversion agree bit exactly
+  auto check = [&channels](auto sample) {
+    using SampleType = decltype(sample);
+    SampleType interleaved[8 * kFrames];
+    PcmStream<SampleType> stream(interleaved, 8);
+    stream.loadInterleaved(kFrames,
+                           channels[0],
+                           channels[1],
+                           channels[2],
+                           channels[3],
+                           channels[4],
+                           channels[5],
+                           channels[6],
+                           channels[7]);
+
+    for(uint32_t c{0}; c < 8; ++c)
+    {
+      for(uint32_t i{0}; i < kFrames; ++i)
+      {
+        auto expected = convert<SampleType>(channels[c][i]);
+        EXPECT_EQ(std::memcmp(&interleaved[i * 8 + c], &expected, sizeof(SampleType)), 0) << c << " " << i;
+      }
+    }
+  };
+
+  check(int16_t{});
+  check(float{});
+  check(SampleS32{});
+  check(SampleS24{});
+  check(SampleS24Packed{});
+}
+
+TEST_F(PcmStreamTest, Test_ConvertSaturation)
+{
+  EXPECT_EQ(convert<int16_t>(0.5f), 16384);
+  EXPECT_EQ(convert<int16_t>(1.0f), 32767);
+  EXPECT_EQ(convert<int16_t>(-1.0f), -32768);
+  EXPECT_EQ(convert<int16_t>(-3.0f), -32768);
+
+  EXPECT_EQ(convert<SampleS32>(0.5f).value, 1 << 30);
+  EXPECT_EQ(convert<SampleS32>(1e10f).value, 2147483520);
+  EXPECT_EQ(convert<SampleS32>(-1.0f).value, std::numeric_limits<int32_t>::min());
+
+  EXPECT_EQ(convert<SampleS24>(-0.5f).value, -(1 << 22));
+  EXPECT_EQ(convert<SampleS24>(2.0f).value, (1 << 23) - 1);
+  EXPECT_EQ(convert<SampleS24>(-2.0f).value, -(1 << 23));
+
+  auto packed = convert<SampleS24Packed>(-1.0f / 8388608);
+  EXPECT_EQ(std::vector<uint8_t>(packed.bytes, packed.bytes + 3), std::vector<uint8_t>({0xff, 0xff, 0xff}));
+  packed = convert<SampleS24Packed>(0.25f);
+  EXPECT_EQ(std::vector<uint8_t>(packed.bytes, packed.bytes + 3), std::vector<uint8_t>({0x00, 0x00, 0x20}));
+}
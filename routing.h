@@ -0,0 +1,283 @@
+#pragma once
+
+#include <alsa/asoundlib.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Routing matrix of the plugin: which input channel feeds which filter of the coefficient
+// file and which output channel of the slave, with a gain per route.
+//
+// Text form, one route per line or separated by ';':
+//   <input> <filter> <output> [gain dB]
+// output is a slave channel index or an ALSA channel position (FL, FR, LFE, ...). Positions
+// are resolved through the channel map of the slave, without one they take the default
+// ALSA order FL FR RL RR FC LFE SL SR. Routes to the same output are summed.
+class Routing
+{
+public:
+  struct Route
+  {
+    uint32_t input;
+    uint32_t filter;
+    uint32_t position;  // SND_CHMAP_UNKNOWN => fixed channel
+    uint32_t channel;
+    float gain;  // linear
+  };
+
+  Routing() = default;
+
+  explicit Routing(const std::vector<Route>& routes) : routes_{routes}
+  {
+    for(uint32_t i{0}; i < routes_.size(); ++i)
+    {
+      auto& route = routes_[i];
+      numInputs_ = std::max(numInputs_, route.input + 1);
+      numFilters_ = std::max(numFilters_, route.filter + 1);
+
+      if(route.position == SND_CHMAP_UNKNOWN)
+      {
+        numOutputChannels_ = std::max(numOutputChannels_, route.channel + 1);
+      }
+      else if(auto slot = std::find(kDefaultOrder.begin(), kDefaultOrder.end(), route.position);
+              slot != kDefaultOrder.end())
+      {
+        numOutputChannels_ = std::max<uint32_t>(numOutputChannels_, slot - kDefaultOrder.begin() + 1);
+      }
+
+      auto first = std::find_if(routes_.begin(), routes_.begin() + i, [&route](auto& other) {
+        return other.position == route.position && other.channel == route.channel;
+      });
+      outputs_.push_back(first == routes_.begin() + i ? numOutputs_++ : outputs_[first - routes_.begin()]);
+    }
+  }
+
+  // 3 in/7 filter layout: L => FL RL SL, R => FR RR SR, LFE => LFE
+  static Routing getDefault() { return parse("0 0 FL; 0 1 RL; 0 2 SL; 1 3 FR; 1 4 RR; 1 5 SR; 2 6 LFE"); }
+
+  // throws std::invalid_argument
+  static Routing parse(const std::string& str)
+  {
+    std::vector<Route> routes;
+
+    auto lines = str;
+    std::replace(lines.begin(), lines.end(), '\n', ';');
+
+    std::string entry;
+    std::istringstream entries{lines};
+    while(std::getline(entries, entry, ';'))
+    {
+      std::istringstream fields{entry};
+      std::string output;
+      Route route{0, 0, SND_CHMAP_UNKNOWN, 0, 1.0f};
+
+      if(!(fields >> route.input))
+      {
+        // blank entry, e.g. after a trailing ';'
+        if(entry.find_first_not_of(" \t\r") == std::string::npos)
+        {
+          continue;
+        }
+        throw std::invalid_argument("Error: invalid route '" + entry + "'");
+      }
+
+      if(!(fields >> route.filter >> output))
+      {
+        throw std::invalid_argument("Error: invalid route '" + entry + "'");
+      }
+
+      if(std::isdigit(output[0]))
+      {
+        route.channel = std::stoul(output);
+      }
+      else
+      {
+        route.position = getPosition(output);
+      }
+
+      float gainDb{0.0f};
+      if(fields >> gainDb)
+      {
+        route.gain = std::pow(10.0f, gainDb / 20);
+      }
+
+      if(!fields.eof())
+      {
+        throw std::invalid_argument("Error: invalid route '" + entry + "'");
+      }
+
+      routes.push_back(route);
+    }
+
+    return Routing{routes};
+  }
+
+  // "# route: <input> <filter> <output> [gain dB]" comment lines of a coefficient file,
+  // empty if there are none
+  static Routing load(const std::string& path)
+  {
+    std::ifstream file(path);
+    std::string line;
+    std::string routes;
+
+    while(std::getline(file, line))
+    {
+      auto start = line.find_first_not_of(" \t");
+      if(start == std::string::npos || line[start] != '#')
+      {
+        continue;
+      }
+
+      auto tag = line.find_first_not_of(" \t", start + 1);
+      if(tag != std::string::npos && line.compare(tag, 6, "route:") == 0)
+      {
+        routes += line.substr(tag + 6) + ";";
+      }
+    }
+
+    return parse(routes);
+  }
+
+  bool empty() const { return routes_.size() == 0; }
+  const std::vector<Route>& getRoutes() const { return routes_; }
+  uint32_t getNumInputs() const { return numInputs_; }
+  uint32_t getNumFilters() const { return numFilters_; }
+  uint32_t getNumOutputChannels() const { return numOutputChannels_; }
+
+  // distinct outputs of the routes, numbered in the order they first appear
+  uint32_t getNumOutputs() const { return numOutputs_; }
+  uint32_t getOutput(uint32_t route) const { return outputs_[route]; }
+
+  // e.g. a slave with more channels than the routes need
+  void setNumOutputChannels(uint32_t numChannels)
+  {
+    numOutputChannels_ = std::max(numOutputChannels_, numChannels);
+  }
+
+  // default ALSA order, channels beyond it have no position
+  std::vector<uint32_t> getDefaultPositions() const
+  {
+    std::vector<uint32_t> positions(numOutputChannels_, SND_CHMAP_UNKNOWN);
+    auto count = std::min<uint32_t>(positions.size(), kDefaultOrder.size());
+    std::copy_n(kDefaultOrder.begin(), count, positions.begin());
+    return positions;
+  }
+
+  // output index per slave channel of the given positions (channel map), -1 => silence
+  std::vector<int32_t> mapChannels(const std::vector<uint32_t>& positions) const
+  {
+    std::vector<int32_t> map(positions.size(), -1);
+
+    for(uint32_t i{0}; i < map.size(); ++i)
+    {
+      auto matches = [this, i](uint32_t position) {
+        return std::find_if(routes_.begin(), routes_.end(), [i, position](auto& route) {
+          return route.position == SND_CHMAP_UNKNOWN ? route.channel == i : route.position == position;
+        });
+      };
+
+      auto route = matches(positions[i]);
+      if(route == routes_.end())
+      {
+        route = matches(getAlias(positions[i]));
+      }
+
+      if(route != routes_.end())
+      {
+        map[i] = outputs_[route - routes_.begin()];
+      }
+    }
+
+    return map;
+  }
+
+  // FNV-1a over the routes => part of the spectrum cache key (gains are in the filters)
+  uint64_t hash() const
+  {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(auto& route : routes_)
+    {
+      uint32_t gain;
+      std::memcpy(&gain, &route.gain, sizeof(gain));
+
+      for(uint32_t value : {route.input, route.filter, route.position, route.channel, gain})
+      {
+        hash = (hash ^ value) * 0x100000001b3ULL;
+      }
+    }
+
+    return hash;
+  }
+
+protected:
+  static constexpr std::array<uint32_t, 8> kDefaultOrder{SND_CHMAP_FL,
+                                                         SND_CHMAP_FR,
+                                                         SND_CHMAP_RL,
+                                                         SND_CHMAP_RR,
+                                                         SND_CHMAP_FC,
+                                                         SND_CHMAP_LFE,
+                                                         SND_CHMAP_SL,
+                                                         SND_CHMAP_SR};
+
+  static constexpr std::array<std::pair<const char*, uint32_t>, 13> kPositionNames{{
+      {"FL", SND_CHMAP_FL},
+      {"FR", SND_CHMAP_FR},
+      {"RL", SND_CHMAP_RL},
+      {"RR", SND_CHMAP_RR},
+      {"FC", SND_CHMAP_FC},
+      {"LFE", SND_CHMAP_LFE},
+      {"SL", SND_CHMAP_SL},
+      {"SR", SND_CHMAP_SR},
+      {"RC", SND_CHMAP_RC},
+      {"FLC", SND_CHMAP_FLC},
+      {"FRC", SND_CHMAP_FRC},
+      {"RLC", SND_CHMAP_RLC},
+      {"RRC", SND_CHMAP_RRC},
+  }};
+
+  static uint32_t getPosition(const std::string& name)
+  {
+    for(auto& [str, position] : kPositionNames)
+    {
+      if(name == str)
+      {
+        return position;
+      }
+    }
+
+    throw std::invalid_argument("Error: unknown channel position " + name);
+  }
+
+  // side channels reported as center pairs take the side routes
+  static uint32_t getAlias(uint32_t position)
+  {
+    switch(position)
+    {
+      case SND_CHMAP_FLC:
+      case SND_CHMAP_RLC:
+        return SND_CHMAP_SL;
+      case SND_CHMAP_FRC:
+      case SND_CHMAP_RRC:
+        return SND_CHMAP_SR;
+      default:
+        return SND_CHMAP_UNKNOWN;
+    }
+  }
+
+  std::vector<Route> routes_;
+  std::vector<uint32_t> outputs_;  // per route
+  uint32_t numOutputs_{0};
+  uint32_t numInputs_{0};
+  uint32_t numFilters_{0};
+  uint32_t numOutputChannels_{0};
+};
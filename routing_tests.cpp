@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "routing.h"
+
+TEST(RoutingTest, Test_Default)
+{
+  auto routing = Routing::getDefault();
+
+  EXPECT_EQ(routing.getNumInputs(), 3);
+  EXPECT_EQ(routing.getNumFilters(), 7);
+  EXPECT_EQ(routing.getNumOutputChannels(), 8);
+
+  // FL FR RL RR FC LFE SL SR
+  auto map = routing.mapChannels(routing.getDefaultPositions());
+  EXPECT_EQ(map, (std::vector<int32_t>{0, 3, 1, 4, -1, 6, 2, 5}));
+}
+
+TEST(RoutingTest, Test_Parse)
+{
+  auto routing = Routing::parse("0 0 FL -6\n1 1 FR;0 2 9 ; 1 3 8 0;");
+
+  ASSERT_EQ(routing.getRoutes().size(), 4);
+  EXPECT_EQ(routing.getNumInputs(), 2);
+  EXPECT_EQ(routing.getNumFilters(), 4);
+  EXPECT_EQ(routing.getNumOutputChannels(), 10);
+
+  EXPECT_NEAR(routing.getRoutes()[0].gain, 0.501187f, 1e-5f);
+  EXPECT_EQ(routing.getRoutes()[1].gain, 1.0f);
+  EXPECT_EQ(routing.getRoutes()[2].position, SND_CHMAP_UNKNOWN);
+  EXPECT_EQ(routing.getRoutes()[2].channel, 9);
+
+  auto map = routing.mapChannels(routing.getDefaultPositions());
+  EXPECT_EQ(map, (std::vector<int32_t>{0, 1, -1, -1, -1, -1, -1, -1, 3, 2}));
+
+  routing.setNumOutputChannels(12);
+  EXPECT_EQ(routing.getNumOutputChannels(), 12);
+  routing.setNumOutputChannels(2);
+  EXPECT_EQ(routing.getNumOutputChannels(), 12);
+}
+
+TEST(RoutingTest, Test_ChannelMap)
+{
+  auto routing = Routing::getDefault();
+
+  // slave reports the side channels as center pairs and FR first
+  auto map = routing.mapChannels({SND_CHMAP_FR, SND_CHMAP_FL, SND_CHMAP_FLC, SND_CHMAP_FRC, SND_CHMAP_LFE});
+  EXPECT_EQ(map, (std::vector<int32_t>{3, 0, 2, 5, 6}));
+}
+
+TEST(RoutingTest, Test_SummedOutputs)
+{
+  // L + R into the sub, correction filter on top of L
+  auto routing = Routing::parse("0 0 FL; 1 1 FR; 0 2 LFE -6; 1 2 LFE -6; 0 3 FL");
+
+  EXPECT_EQ(routing.getNumOutputs(), 3);
+  EXPECT_EQ(routing.getNumOutputChannels(), 6);
+
+  std::vector<uint32_t> outputs;
+  for(uint32_t i{0}; i < routing.getRoutes().size(); ++i)
+  {
+    outputs.push_back(routing.getOutput(i));
+  }
+  EXPECT_EQ(outputs, (std::vector<uint32_t>{0, 1, 2, 2, 0}));
+
+  auto map = routing.mapChannels(routing.getDefaultPositions());
+  EXPECT_EQ(map, (std::vector<int32_t>{0, 1, -1, -1, -1, 2}));
+}
+
+TEST(RoutingTest, Test_Invalid)
+{
+  EXPECT_THROW(Routing::parse("0 0"), std::invalid_argument);
+  EXPECT_THROW(Routing::parse("0 0 XX"), std::invalid_argument);
+  EXPECT_THROW(Routing::parse("a 0 FL"), std::invalid_argument);
+  EXPECT_THROW(Routing::parse("0 0 FL 3 dB"), std::invalid_argument);
+
+  EXPECT_TRUE(Routing::parse(" ; \n").empty());
+}
+
+TEST(RoutingTest, Test_Load)
+{
+  const char* path = "routing_test.m";
+  {
+    std::ofstream file(path);
+    file << "# name: x\n";
+    file << "  # route: 0 1 FL\n";
+    file << "#route: 1 0 FR -3\n";
+    file << "0.5 0.25\n";
+  }
+
+  auto routing = Routing::load(path);
+  std::remove(path);
+
+  ASSERT_EQ(routing.getRoutes().size(), 2);
+  EXPECT_EQ(routing.getRoutes()[0].filter, 1);
+  EXPECT_EQ(routing.getRoutes()[1].position, SND_CHMAP_FR);
+  EXPECT_EQ(routing.getNumOutputChannels(), 2);
+
+  EXPECT_TRUE(Routing::load("coeffs.m").empty());
+}
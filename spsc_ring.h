@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <span>
+
+// Lock-free single producer single consumer ring.
+//
+// Positions grow monotonically, the slot is position % capacity => any capacity works, e.g.
+// a multiple of the frame size so a frame never wraps. The consumer reads in place through
+// readable() and releases with consume().
+template <typename T>
+class SpscRing
+{
+public:
+  explicit SpscRing(size_t capacity) : capacity_{capacity}, data_{new T[capacity]} {}
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  size_t capacity() const { return capacity_; }
+
+  // any thread, exact only on the producer or consumer side
+  size_t size() const
+  {
+    return writePos_.load(std::memory_order_acquire) - readPos_.load(std::memory_order_acquire);
+  }
+
+  // producer only, returns the number of items written
+  size_t write(const T* data, size_t count)
+  {
+    auto writePos = writePos_.load(std::memory_order_relaxed);
+    count = std::min(count, capacity_ - (writePos - readPos_.load(std::memory_order_acquire)));
+
+    auto offset = writePos % capacity_;
+    auto first = std::min(count, capacity_ - offset);
+    std::memcpy(data_.get() + offset, data, first * sizeof(T));
+    std::memcpy(data_.get(), data + first, (count - first) * sizeof(T));
+
+    writePos_.store(writePos + count, std::memory_order_release);
+    return count;
+  }
+
+  // consumer only, contiguous part of the items available (the rest follows after wrapping)
+  std::span<T> readable()
+  {
+    auto readPos = readPos_.load(std::memory_order_relaxed);
+    auto available = writePos_.load(std::memory_order_acquire) - readPos;
+    auto offset = readPos % capacity_;
+
+    return {data_.get() + offset, std::min(available, capacity_ - offset)};
+  }
+
+  // consumer only
+  void consume(size_t count)
+  {
+    readPos_.store(readPos_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+  }
+
+  // neither side may be active
+  void clear()
+  {
+    writePos_.store(0, std::memory_order_relaxed);
+    readPos_.store(0, std::memory_order_relaxed);
+  }
+
+protected:
+  size_t capacity_;
+  std::unique_ptr<T[]> data_;
+  alignas(64) std::atomic<uint64_t> writePos_{0};
+  alignas(64) std::atomic<uint64_t> readPos_{0};
+};
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "spsc_ring.h"
+
+class SpscRingTest : public testing::Test
+{
+protected:
+  // reads everything available, wrapped part included
+  std::vector<uint32_t> readAll(SpscRing<uint32_t>& ring)
+  {
+    std::vector<uint32_t> result;
+    for(auto data = ring.readable(); data.size() > 0; data = ring.readable())
+    {
+      result.insert(result.end(), data.begin(), data.end());
+      ring.consume(data.size());
+    }
+    return result;
+  }
+};
+
+TEST_F(SpscRingTest, Test_WriteRead)
+{
+  SpscRing<uint32_t> ring{12};  // 4 frames of 3 channels
+  std::vector<uint32_t> data(30);
+  std::iota(data.begin(), data.end(), 0);
+
+  EXPECT_EQ(ring.write(data.data(), 9), 9);
+  EXPECT_EQ(ring.size(), 9);
+
+  // full => partial write
+  EXPECT_EQ(ring.write(data.data() + 9, 6), 3);
+  EXPECT_EQ(ring.write(data.data() + 12, 3), 0);
+  EXPECT_EQ(readAll(ring), std::vector<uint32_t>(data.begin(), data.begin() + 12));
+
+  // wraps around at the end of the ring
+  EXPECT_EQ(ring.write(data.data() + 12, 6), 6);
+  ring.consume(ring.readable().size());
+  EXPECT_EQ(ring.write(data.data() + 18, 9), 9);
+  EXPECT_EQ(ring.readable().size(), 6);
+  EXPECT_EQ(readAll(ring), std::vector<uint32_t>(data.begin() + 18, data.begin() + 27));
+  EXPECT_EQ(ring.size(), 0);
+}
+
+TEST_F(SpscRingTest, Test_ProducerConsumer)
+{
+  constexpr uint32_t kItems = 200000;
+  SpscRing<uint32_t> ring{96};
+
+  std::thread producer([&ring] {
+    uint32_t block[7];
+    for(uint32_t next{0}; next < kItems;)
+    {
+      auto count = std::min<uint32_t>(7, kItems - next);
+      std::iota(block, block + count, next);
+      auto written = ring.write(block, count);
+      if(written == 0)
+      {
+        std::this_thread::yield();
+      }
+      next += written;
+    }
+  });
+
+  uint32_t expected{0};
+  while(expected < kItems)
+  {
+    auto data = ring.readable();
+    if(data.size() == 0)
+    {
+      std::this_thread::yield();
+    }
+
+    for(auto value : data)
+    {
+      ASSERT_EQ(value, expected++);
+    }
+    ring.consume(data.size());
+  }
+
+  producer.join();
+  EXPECT_EQ(ring.size(), 0);
+}
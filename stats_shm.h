@@ -0,0 +1,216 @@
+#pragma once
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include "latency_histogram.h"
+
+// Live statistics of the plugin, as published to the shared memory block.
+struct DxoStats
+{
+  static constexpr uint32_t kMaxWorkers = 16;
+  static constexpr uint32_t kMaxTasks = 16;
+
+  // run time of the tasks of one label (fft, ifft, ...) since the export started
+  struct TaskTime
+  {
+    char label[24];  // zero terminated
+    uint64_t count;
+    uint64_t totalNs;
+    uint64_t maxNs;
+  };
+
+  uint64_t timeNs;  // CLOCK_MONOTONIC of the sample
+  uint32_t pid;
+  uint32_t blockSize;
+  uint64_t deadlineNs;  // one block at the stream rate, 0 => not prepared
+  uint64_t deadlineMisses;
+  uint64_t xruns;
+  uint64_t recoveries;
+  LatencyHistogram::Snapshot processTime;
+  LatencyHistogram::Snapshot writeTime;
+  uint32_t numWorkers;
+  uint32_t numTasks;
+  std::array<uint64_t, kMaxWorkers> workerCpuNs;
+  std::array<TaskTime, kMaxTasks> tasks;  // most time first
+};
+
+// Statistics block in /dev/shm: one writer (the plugin) publishes, any number of readers
+// attach read only, e.g. the dxo_stats tool.
+//
+// Lock-free through a sequence counter: odd while the writer copies, readers retry if it
+// was odd or changed during their copy. The payload is stored as relaxed atomic words =>
+// no torn reads and no data race under the C++ memory model. magic/version/size describe the
+// layout, a reader rejects blocks of another version.
+class StatsShm
+{
+public:
+  static constexpr uint32_t kMagic = 0x4f5844;  // "DXO"
+  static constexpr uint32_t kVersion = 2;  // 2: task times
+
+  StatsShm(const StatsShm&) = delete;
+  StatsShm& operator=(const StatsShm&) = delete;
+
+  ~StatsShm()
+  {
+    munmap(shared_, sizeof(Shared));
+
+    if(owner_)
+    {
+      shm_unlink(name_.c_str());
+    }
+  }
+
+  // "dxo" => /dev/shm/dxo, nullptr on error (errno is set)
+  static std::unique_ptr<StatsShm> create(const std::string& name)
+  {
+    auto path = getPath(name);
+    int fd = shm_open(path.c_str(), O_CREAT | O_RDWR, 0644);
+    if(fd < 0)
+    {
+      return nullptr;
+    }
+
+    auto mapping = ftruncate(fd, sizeof(Shared)) == 0
+                       ? mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                       : MAP_FAILED;
+    close(fd);
+
+    if(mapping == MAP_FAILED)
+    {
+      shm_unlink(path.c_str());
+      return nullptr;
+    }
+
+    // header last => a reader attaching meanwhile sees no valid block yet
+    auto shared = new(mapping) Shared{};
+    shared->size = sizeof(DxoStats);
+    shared->version = kVersion;
+    std::atomic_thread_fence(std::memory_order_release);
+    shared->magic = kMagic;
+
+    return std::unique_ptr<StatsShm>(new StatsShm(shared, path, true));
+  }
+
+  // read only, nullptr if there is no block of this version
+  static std::unique_ptr<StatsShm> attach(const std::string& name)
+  {
+    auto path = getPath(name);
+    int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if(fd < 0)
+    {
+      return nullptr;
+    }
+
+    struct stat info{};
+    auto mapping = fstat(fd, &info) == 0 && info.st_size >= static_cast<off_t>(sizeof(Shared))
+                       ? mmap(nullptr, sizeof(Shared), PROT_READ, MAP_SHARED, fd, 0)
+                       : MAP_FAILED;
+    close(fd);
+
+    if(mapping == MAP_FAILED)
+    {
+      return nullptr;
+    }
+
+    auto shared = static_cast<Shared*>(mapping);
+    if(shared->magic != kMagic || shared->version != kVersion || shared->size != sizeof(DxoStats))
+    {
+      munmap(mapping, sizeof(Shared));
+      return nullptr;
+    }
+
+    return std::unique_ptr<StatsShm>(new StatsShm(shared, path, false));
+  }
+
+  // single writer only
+  void publish(const DxoStats& stats)
+  {
+    std::array<uint64_t, kNumWords> words;
+    std::memcpy(words.data(), &stats, sizeof(stats));
+
+    auto sequence = shared_->sequence.load(std::memory_order_relaxed);
+    shared_->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for(uint32_t i{0}; i < kNumWords; ++i)
+    {
+      shared_->words[i].store(words[i], std::memory_order_relaxed);
+    }
+
+    shared_->sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  // false => nothing published yet or the writer kept it busy
+  bool read(DxoStats& stats) const
+  {
+    std::array<uint64_t, kNumWords> words;
+
+    for(uint32_t retry{0}; retry < kMaxRetries; ++retry)
+    {
+      auto sequence = shared_->sequence.load(std::memory_order_acquire);
+      if(sequence == 0)
+      {
+        return false;
+      }
+
+      if(sequence % 2 == 1)
+      {
+        std::this_thread::yield();
+        continue;
+      }
+
+      for(uint32_t i{0}; i < kNumWords; ++i)
+      {
+        words[i] = shared_->words[i].load(std::memory_order_relaxed);
+      }
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(shared_->sequence.load(std::memory_order_relaxed) == sequence)
+      {
+        std::memcpy(static_cast<void*>(&stats), words.data(), sizeof(stats));
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+protected:
+  static_assert(std::is_trivially_copyable_v<DxoStats> && sizeof(DxoStats) % sizeof(uint64_t) == 0);
+  static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must not need a lock");
+
+  static constexpr uint32_t kNumWords = sizeof(DxoStats) / sizeof(uint64_t);
+  static constexpr uint32_t kMaxRetries = 1000;
+
+  struct Shared
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;  // of the payload
+    std::atomic<uint32_t> sequence;
+    std::array<std::atomic<uint64_t>, kNumWords> words;
+  };
+
+  StatsShm(Shared* shared, const std::string& name, bool owner) : shared_{shared}, name_{name}, owner_{owner}
+  {
+  }
+
+  static std::string getPath(const std::string& name) { return name.starts_with('/') ? name : "/" + name; }
+
+  Shared* shared_;
+  std::string name_;
+  bool owner_;
+};
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "stats_shm.h"
+
+using namespace std::chrono_literals;
+
+TEST(StatsShmTest, Test_PublishRead)
+{
+  auto writer = StatsShm::create("dxo_stats_test");
+  ASSERT_NE(writer, nullptr);
+
+  auto reader = StatsShm::attach("/dxo_stats_test");
+  ASSERT_NE(reader, nullptr);
+
+  DxoStats stats{};
+  EXPECT_FALSE(reader->read(stats));
+
+  LatencyHistogram histogram;
+  histogram.record(100us);
+  histogram.record(3ms);
+
+  DxoStats published{};
+  published.pid = 42;
+  published.blockSize = 256;
+  published.xruns = 3;
+  published.processTime = histogram.getSnapshot();
+  published.numWorkers = 2;
+  published.workerCpuNs[1] = 123456789;
+  published.numTasks = 1;
+  published.tasks[0] = {"ifft", 10, 12000, 3000};
+  writer->publish(published);
+
+  ASSERT_TRUE(reader->read(stats));
+  EXPECT_EQ(stats.pid, 42);
+  EXPECT_EQ(stats.blockSize, 256);
+  EXPECT_EQ(stats.xruns, 3);
+  EXPECT_EQ(stats.processTime.count, 2);
+  EXPECT_EQ(stats.processTime.maxNs, 3'000'000);
+  EXPECT_EQ(stats.workerCpuNs[1], 123456789);
+  EXPECT_EQ(stats.numTasks, 1);
+  EXPECT_STREQ(stats.tasks[0].label, "ifft");
+  EXPECT_EQ(stats.tasks[0].totalNs, 12000);
+
+  // writer gone => block removed
+  writer.reset();
+  EXPECT_EQ(StatsShm::attach("dxo_stats_test"), nullptr);
+}
+
+TEST(StatsShmTest, Test_Version)
+{
+  // block of an unknown layout, e.g. an older plugin
+  int fd = shm_open("/dxo_stats_version_test", O_CREAT | O_RDWR, 0644);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(ftruncate(fd, 4096), 0);
+  uint32_t header[3]{StatsShm::kMagic, StatsShm::kVersion + 1, sizeof(DxoStats)};
+  ASSERT_EQ(write(fd, header, sizeof(header)), sizeof(header));
+  close(fd);
+
+  EXPECT_EQ(StatsShm::attach("dxo_stats_version_test"), nullptr);
+  shm_unlink("/dxo_stats_version_test");
+
+  EXPECT_EQ(StatsShm::attach("dxo_stats_missing"), nullptr);
+}
+
+TEST(StatsShmTest, Test_ConcurrentRead)
+{
+  auto writer = StatsShm::create("dxo_stats_concurrent_test");
+  ASSERT_NE(writer, nullptr);
+  auto reader = StatsShm::attach("dxo_stats_concurrent_test");
+  ASSERT_NE(reader, nullptr);
+
+  std::atomic<bool> done{false};
+  std::thread publisher([&] {
+    DxoStats stats{};
+    for(uint64_t i{1}; i <= 200000; ++i)
+    {
+      // every sample is consistent: all counters carry the same value
+      stats.xruns = stats.recoveries = stats.deadlineMisses = stats.timeNs = i;
+      stats.workerCpuNs.fill(i);
+      writer->publish(stats);
+    }
+    done = true;
+  });
+
+  uint64_t last{0};
+  uint32_t numReads{0};
+  while(!done)
+  {
+    DxoStats stats;
+    if(reader->read(stats))
+    {
+      EXPECT_EQ(stats.recoveries, stats.xruns);
+      EXPECT_EQ(stats.timeNs, stats.xruns);
+      EXPECT_EQ(stats.workerCpuNs.back(), stats.xruns);
+      EXPECT_GE(stats.xruns, last);
+      last = stats.xruns;
+      ++numReads;
+    }
+  }
+  publisher.join();
+
+  EXPECT_GT(numReads, 0);
+}
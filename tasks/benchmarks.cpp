@@ -0,0 +1,93 @@
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "static_schedule.h"
+#include "tasks.h"
+
+// Crossover shaped graph of empty tasks: per filter a partial sum that may run before the
+// inputs and a combine that needs them, all joined by one final task. What is measured per
+// block is the scheduling overhead alone.
+class EmptyGraph
+{
+public:
+  explicit EmptyGraph(uint32_t numFilters) : numTasks_{getNumInputs(numFilters) + 2 * numFilters + 2}
+  {
+    auto empty = [](Task&) {};
+
+    // every input feeds a filter => only the last task is final
+    auto numInputs = getNumInputs(numFilters);
+    for(uint32_t i{0}; i < numInputs; ++i)
+    {
+      inputJobs_.push_back(Task::create<uint32_t>(empty));
+    }
+
+    auto root = Task::create<uint32_t>(empty);
+    backgroundJobs_.push_back(root);
+
+    std::vector<std::shared_ptr<Task>> results;
+    for(uint32_t i{0}; i < numFilters; ++i)
+    {
+      auto partial = Task::create<uint32_t>(empty, {root});
+      results.push_back(Task::create<uint32_t>(empty, {inputJobs_[i % numInputs], partial}));
+    }
+
+    backgroundJobs_.push_back(Task::create<uint32_t>(empty, results));
+  }
+
+  static uint32_t getNumInputs(uint32_t numFilters) { return std::min(3U, numFilters); }
+
+  std::vector<std::shared_ptr<Task>> inputJobs_;
+  std::vector<std::shared_ptr<Task>> backgroundJobs_;
+  uint32_t numTasks_;  // inputs, root, partial + combine per filter, final
+};
+
+// block loop of FirMultiChannelCrossover on the work stealing runner
+static void BM_TaskRunnerDispatch(benchmark::State& state)
+{
+  const uint32_t numFilters = state.range(0);
+  const uint32_t numThreads = state.range(1);
+
+  EmptyGraph graph(numFilters);
+  TaskRunner runner(numThreads);
+  runner.run(graph.backgroundJobs_, false);
+
+  for(auto _ : state)
+  {
+    runner.run(graph.inputJobs_);
+    runner.run(graph.backgroundJobs_, false);
+  }
+
+  // drain the background run before the graph goes away
+  runner.run(graph.inputJobs_);
+
+  state.SetItemsProcessed(state.iterations() * graph.numTasks_);
+}
+
+BENCHMARK(BM_TaskRunnerDispatch)->ArgsProduct({{1, 8, 32}, {1, 2, 3, 4}})->UseRealTime();
+
+// same graph on fixed per thread lists
+static void BM_StaticScheduleDispatch(benchmark::State& state)
+{
+  const uint32_t numFilters = state.range(0);
+  const uint32_t numThreads = state.range(1);
+
+  EmptyGraph graph(numFilters);
+  StaticSchedule schedule(graph.inputJobs_, graph.backgroundJobs_, numThreads);
+  schedule.startBlock();
+
+  for(auto _ : state)
+  {
+    schedule.finishBlock();
+    schedule.startBlock();
+  }
+
+  schedule.finishBlock();
+
+  state.SetItemsProcessed(state.iterations() * graph.numTasks_);
+}
+
+BENCHMARK(BM_StaticScheduleDispatch)->ArgsProduct({{1, 8, 32}, {1, 2, 3, 4}})->UseRealTime();
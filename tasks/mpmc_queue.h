@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded multi producer multi consumer queue (D. Vyukov's sequence ring).
+//
+// Each cell carries a sequence number that tells producers and consumers whose turn it is,
+// so a position is never reused until the previous lap is done. Unlike a Treiber stack
+// there is no head pointer to compare against => no ABA when the same item is popped and
+// pushed again while another thread is between its load and its CAS.
+template <typename T>
+class MpmcQueue
+{
+public:
+  // capacity must be a power of two
+  explicit MpmcQueue(uint32_t capacity) : mask_{capacity - 1}, cells_(capacity)
+  {
+    for(size_t i{0}; i < capacity; ++i)
+    {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpmcQueue(const MpmcQueue&) = delete;
+  MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+  // returns false if the queue is full
+  bool push(T item)
+  {
+    auto pos = enqueuePos_.load(std::memory_order_relaxed);
+
+    while(true)
+    {
+      auto& cell = cells_[pos & mask_];
+      auto seq = cell.sequence.load(std::memory_order_acquire);
+      auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+      if(dif == 0)
+      {
+        if(enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          cell.item = item;
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if(dif < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // returns nullptr if the queue is empty
+  T pop()
+  {
+    auto pos = dequeuePos_.load(std::memory_order_relaxed);
+
+    while(true)
+    {
+      auto& cell = cells_[pos & mask_];
+      auto seq = cell.sequence.load(std::memory_order_acquire);
+      auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+      if(dif == 0)
+      {
+        if(dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          auto item = cell.item;
+          cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+          return item;
+        }
+      }
+      else if(dif < 0)
+      {
+        return nullptr;
+      }
+      else
+      {
+        pos = dequeuePos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool empty() const
+  {
+    return dequeuePos_.load(std::memory_order_relaxed) == enqueuePos_.load(std::memory_order_relaxed);
+  }
+
+protected:
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    T item;
+  };
+
+  size_t mask_;
+  std::vector<Cell> cells_;
+  alignas(64) std::atomic<size_t> enqueuePos_{0};
+  alignas(64) std::atomic<size_t> dequeuePos_{0};
+};
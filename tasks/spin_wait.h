@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <thread>
+
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__arm__) || defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// spinning only pays off if every worker and the caller have a core of their own
+inline std::chrono::nanoseconds getDefaultSpinTime(uint32_t numThreads)
+{
+  using namespace std::chrono_literals;
+  return std::thread::hardware_concurrency() > numThreads ? 20us : 0us;
+}
+
+// polls done() for up to spinTime, returns true as soon as it holds
+template <typename Predicate>
+bool spinFor(const Predicate& done, std::chrono::nanoseconds spinTime)
+{
+  if(spinTime.count() <= 0)
+  {
+    return false;
+  }
+
+  auto end = std::chrono::steady_clock::now() + spinTime;
+  for(uint32_t i{1};; ++i)
+  {
+    if(done())
+    {
+      return true;
+    }
+
+    // reading the clock is not free => check it (and let other threads in) every 64 rounds
+    if(i % 64 == 0)
+    {
+      if(std::chrono::steady_clock::now() >= end)
+      {
+        return false;
+      }
+      std::this_thread::yield();
+    }
+
+    cpuRelax();
+  }
+}
@@ -0,0 +1,444 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "spin_wait.h"
+#include "tasks.h"
+#include "thread_config.h"
+
+// Task graph compiled into a fixed execution list per thread.
+//
+// The graph of the crossover never changes, so instead of resolving dependencies through
+// counters and queues on every block, each task is assigned to one thread ahead of time
+// (list scheduling by measured cost). A worker walks its list in order and only waits on
+// the done flags of dependencies that run on other threads.
+//
+// Like TaskRunner, a block is split in two steps:
+//   startBlock():  tasks not depending on the inputs may run (e.g. MACs of older partitions)
+//   finishBlock(): inputs are ready, returns when all tasks of the block are done
+class StaticSchedule
+{
+public:
+  using Costs = std::unordered_map<const Task*, double>;
+
+  StaticSchedule(const std::vector<std::shared_ptr<Task>>& inputTasks,
+                 const std::vector<std::shared_ptr<Task>>& tasks,
+                 uint32_t numThreads,
+                 const Costs& costs = {})
+      : lists_(std::max(1U, numThreads)), workerDone_{new Flag[lists_.size()]}
+  {
+    spinTime_ = getDefaultSpinTime(lists_.size());
+
+    compile(inputTasks, tasks, costs);
+
+    for(auto& list : lists_)
+    {
+      workers_.emplace_back([this, &list] {
+        TaskProfiler::global().registerThread("static worker " + std::to_string(&list - lists_.data()));
+        threadRun(list);
+        TaskProfiler::global().unregisterThread();
+      });
+    }
+  }
+
+  StaticSchedule(const StaticSchedule&) = delete;
+  StaticSchedule& operator=(const StaticSchedule&) = delete;
+
+  ~StaticSchedule()
+  {
+    stop_.store(true);
+
+    // release every wait => workers see stop_ and leave
+    release(backgroundEpoch_, kStopEpoch);
+    release(inputEpoch_, kStopEpoch);
+    for(uint32_t i{0}; i < taskDone_.size(); ++i)
+    {
+      release(taskDone_[i]->epoch, kStopEpoch);
+    }
+
+    for(auto& worker : workers_)
+    {
+      worker.join();
+    }
+  }
+
+  // returns 0 or the first error (errno value)
+  int configure(const ThreadConfig& config)
+  {
+    if(config.spinTime)
+    {
+      setSpinTime(*config.spinTime);
+    }
+
+    return config.apply(workers_);
+  }
+
+  // waits poll this long before they block, 0 => block at once
+  void setSpinTime(std::chrono::nanoseconds spinTime)
+  {
+    spinTime_.store(spinTime, std::memory_order_relaxed);
+  }
+
+  // per worker
+  std::vector<std::chrono::nanoseconds> getCpuTimes() { return ::getCpuTimes(workers_); }
+
+  void startBlock() { release(backgroundEpoch_, ++epoch_); }
+
+  void finishBlock()
+  {
+    release(inputEpoch_, epoch_);
+
+    for(uint32_t i{0}; i < lists_.size(); ++i)
+    {
+      waitFor(workerDone_[i].epoch, epoch_);
+    }
+  }
+
+  // all tasks connected to the given ones in dependency order
+  static std::vector<Task*> collect(const std::vector<std::shared_ptr<Task>>& tasks)
+  {
+    std::unordered_set<Task*> found;
+    std::vector<Task*> pending;
+    for(auto& t : tasks)
+    {
+      pending.push_back(t.get());
+    }
+
+    while(pending.size() > 0)
+    {
+      auto task = pending.back();
+      pending.pop_back();
+
+      if(found.insert(task).second)
+      {
+        for(auto& d : task->getDependencies())
+        {
+          pending.push_back(d.get());
+        }
+        for(auto& d : task->getDependents())
+        {
+          pending.push_back(d.get());
+        }
+      }
+    }
+
+    // Kahn's algorithm
+    std::unordered_map<Task*, uint32_t> numDeps;
+    std::vector<Task*> order;
+    for(auto task : found)
+    {
+      numDeps[task] = task->getDependencies().size();
+      if(numDeps[task] == 0)
+      {
+        order.push_back(task);
+      }
+    }
+
+    for(uint32_t i{0}; i < order.size(); ++i)
+    {
+      for(auto& d : order[i]->getDependents())
+      {
+        if(--numDeps[d.get()] == 0)
+        {
+          order.push_back(d.get());
+        }
+      }
+    }
+
+    return order;
+  }
+
+  // average run time in seconds of each task, runs the whole graph rounds times on the
+  // calling thread => only call while no block is in flight
+  static Costs measure(const std::vector<std::shared_ptr<Task>>& tasks, uint32_t rounds)
+  {
+    Costs costs;
+    auto order = collect(tasks);
+
+    for(uint32_t i{0}; i < rounds; ++i)
+    {
+      for(auto task : order)
+      {
+        auto start = std::chrono::steady_clock::now();
+        task->run();
+        auto end = std::chrono::steady_clock::now();
+
+        costs[task] += std::chrono::duration<double>(end - start).count() / rounds;
+      }
+    }
+
+    return costs;
+  }
+
+  std::vector<std::vector<Task*>> getLists() const
+  {
+    std::vector<std::vector<Task*>> lists;
+    for(auto& list : lists_)
+    {
+      lists.emplace_back();
+      for(auto& step : list)
+      {
+        lists.back().push_back(step.task);
+      }
+    }
+    return lists;
+  }
+
+protected:
+  static constexpr uint64_t kStopEpoch = std::numeric_limits<uint64_t>::max();
+
+  struct alignas(64) Flag
+  {
+    std::atomic<uint64_t> epoch{0};
+  };
+
+  struct Step
+  {
+    Task* task;
+    std::atomic<uint64_t>* done;  // nullptr if no other thread depends on the task
+    std::vector<const std::atomic<uint64_t>*> waits;  // dependencies on other threads
+    bool isInput;
+  };
+
+  // List scheduling (highest bottom level first, earliest finish thread). Tasks independent
+  // of the inputs are placed first, they run while the previous block is written out. The
+  // input dependent part starts on all threads at the same time when the inputs arrive.
+  void compile(const std::vector<std::shared_ptr<Task>>& inputTasks,
+               const std::vector<std::shared_ptr<Task>>& tasks,
+               const Costs& costs)
+  {
+    std::vector<std::shared_ptr<Task>> all(inputTasks);
+    all.insert(all.end(), tasks.begin(), tasks.end());
+    auto order = collect(all);
+
+    auto getCost = [&costs](const Task* task) {
+      auto it = costs.find(task);
+      return it != costs.end() ? it->second : 1.0;
+    };
+
+    std::unordered_set<const Task*> inputDependent;
+    for(auto& t : inputTasks)
+    {
+      inputDependent.insert(t.get());
+    }
+
+    for(auto task : order)
+    {
+      for(auto& d : task->getDependencies())
+      {
+        if(inputDependent.count(d.get()))
+        {
+          inputDependent.insert(task);
+        }
+      }
+    }
+
+    std::unordered_map<const Task*, double> bottomLevel;
+    for(auto it = order.rbegin(); it != order.rend(); ++it)
+    {
+      double level{0.0};
+      for(auto& d : (*it)->getDependents())
+      {
+        level = std::max(level, bottomLevel[d.get()]);
+      }
+      bottomLevel[*it] = level + getCost(*it);
+    }
+
+    std::unordered_map<const Task*, double> finish;
+    std::unordered_map<const Task*, uint32_t> thread;
+    std::vector<double> threadFree(lists_.size(), 0.0);
+
+    for(bool inputPhase : {false, true})
+    {
+      if(inputPhase)
+      {
+        std::fill(threadFree.begin(), threadFree.end(), 0.0);
+      }
+
+      std::vector<Task*> phase;
+      std::unordered_map<const Task*, uint32_t> numDeps;
+      std::vector<Task*> ready;
+      for(auto task : order)
+      {
+        if((inputDependent.count(task) > 0) == inputPhase)
+        {
+          phase.push_back(task);
+          numDeps[task] = 0;
+        }
+      }
+
+      for(auto task : phase)
+      {
+        for(auto& d : task->getDependencies())
+        {
+          numDeps[task] += numDeps.count(d.get());
+        }
+        if(numDeps[task] == 0)
+        {
+          ready.push_back(task);
+        }
+      }
+
+      while(ready.size() > 0)
+      {
+        auto next = std::max_element(ready.begin(), ready.end(), [&bottomLevel](auto a, auto b) {
+          return bottomLevel[a] < bottomLevel[b];
+        });
+        auto task = *next;
+        ready.erase(next);
+
+        // dependencies of the previous phase are done when this one starts
+        double depsDone{0.0};
+        for(auto& d : task->getDependencies())
+        {
+          if(numDeps.count(d.get()))
+          {
+            depsDone = std::max(depsDone, finish[d.get()]);
+          }
+        }
+
+        uint32_t best{0};
+        for(uint32_t i{1}; i < threadFree.size(); ++i)
+        {
+          if(std::max(threadFree[i], depsDone) < std::max(threadFree[best], depsDone))
+          {
+            best = i;
+          }
+        }
+
+        finish[task] = std::max(threadFree[best], depsDone) + getCost(task);
+        threadFree[best] = finish[task];
+        thread[task] = best;
+
+        auto isInput = task->getDependencies().size() == 0 && inputDependent.count(task) > 0;
+        taskDone_.push_back(std::make_unique<Flag>());
+        lists_[best].push_back({task, &taskDone_.back()->epoch, {}, isInput});
+
+        for(auto& d : task->getDependents())
+        {
+          if(numDeps.count(d.get()) && --numDeps[d.get()] == 0)
+          {
+            ready.push_back(d.get());
+          }
+        }
+      }
+    }
+
+    // wait only for dependencies placed on other threads
+    std::unordered_map<const Task*, std::atomic<uint64_t>*> doneFlags;
+    for(auto& list : lists_)
+    {
+      for(auto& step : list)
+      {
+        doneFlags[step.task] = step.done;
+      }
+    }
+
+    std::unordered_set<const std::atomic<uint64_t>*> waited;
+    for(uint32_t i{0}; i < lists_.size(); ++i)
+    {
+      for(auto& step : lists_[i])
+      {
+        for(auto& d : step.task->getDependencies())
+        {
+          if(thread[d.get()] != i)
+          {
+            step.waits.push_back(doneFlags[d.get()]);
+            waited.insert(doneFlags[d.get()]);
+          }
+        }
+      }
+    }
+
+    // nobody waits => skip the store and the wake up
+    for(auto& list : lists_)
+    {
+      for(auto& step : list)
+      {
+        if(waited.count(step.done) == 0)
+        {
+          step.done = nullptr;
+        }
+      }
+    }
+  }
+
+  // spin shortly (next task usually follows within microseconds), then block in the kernel
+  bool waitFor(const std::atomic<uint64_t>& flag, uint64_t epoch) const
+  {
+    spinFor([&flag, epoch] { return flag.load(std::memory_order_acquire) >= epoch; },
+            spinTime_.load(std::memory_order_relaxed));
+
+    for(auto value = flag.load(std::memory_order_acquire); value < epoch;
+        value = flag.load(std::memory_order_acquire))
+    {
+      flag.wait(value, std::memory_order_acquire);
+    }
+
+    return !stop_.load(std::memory_order_relaxed);
+  }
+
+  static void release(std::atomic<uint64_t>& flag, uint64_t epoch)
+  {
+    flag.store(epoch, std::memory_order_release);
+    flag.notify_all();
+  }
+
+  void threadRun(std::vector<Step>& list)
+  {
+    auto& done = workerDone_[&list - lists_.data()].epoch;
+
+    for(uint64_t epoch{1};; ++epoch)
+    {
+      if(!waitFor(backgroundEpoch_, epoch))
+      {
+        return;
+      }
+
+      for(auto& step : list)
+      {
+        if(step.isInput && !waitFor(inputEpoch_, epoch))
+        {
+          return;
+        }
+
+        for(auto w : step.waits)
+        {
+          if(!waitFor(*w, epoch))
+          {
+            return;
+          }
+        }
+
+        step.task->runWithHooks();
+
+        if(step.done)
+        {
+          release(*step.done, epoch);
+        }
+      }
+
+      release(done, epoch);
+    }
+  }
+
+  std::vector<std::vector<Step>> lists_;
+  std::unique_ptr<Flag[]> workerDone_;
+  std::vector<std::unique_ptr<Flag>> taskDone_;
+  std::vector<std::thread> workers_;
+  std::atomic<bool> stop_{false};
+  std::atomic<std::chrono::nanoseconds> spinTime_{};
+  uint64_t epoch_{0};
+  alignas(64) std::atomic<uint64_t> backgroundEpoch_{0};
+  alignas(64) std::atomic<uint64_t> inputEpoch_{0};
+};
@@ -0,0 +1,443 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef DXO_PROFILE
+constexpr bool kTaskProfiling = true;
+#else
+constexpr bool kTaskProfiling = false;  // hooks compile to nothing
+#endif
+
+class Task;
+
+// Start/end time of every task run, recorded by the worker into a ring of its own (no shared
+// writes between threads, no allocation after the first event of a thread). Old events are
+// overwritten once a ring is full.
+//
+// The recorded runs are exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+// and analysed for the critical path of each block: starting at the task that finished
+// last, walk back along the dependency that finished last. That dependency is looked up by
+// the task while it runs and stored in the event (cause), the analysis only compares
+// pointers and works after the tasks are gone. The reads expect no block in flight, e.g.
+// after the stream is stopped.
+//
+// Independent of DXO_PROFILE, enableLabelTiming sums up the run time per label (count, total,
+// max) in relaxed atomics of each thread: cheap enough to stay on while the stream runs and
+// safe to read at any time (see getLabelTimes). Only threads with a log are timed, workers
+// register theirs when they start => the audio thread running the final task is left alone.
+class TaskProfiler
+{
+public:
+  struct Event
+  {
+    const Task* task;
+    const Task* cause;  // dependency that finished last, nullptr for roots
+    const char* label;
+    uint64_t block;
+    int64_t startNs;
+    int64_t endNs;
+    uint32_t thread;
+  };
+
+  struct CriticalPath
+  {
+    uint64_t block;
+    int64_t wallNs;    // first start to last end of the block
+    int64_t lengthNs;  // run time of the tasks on the path
+    std::vector<Event> tasks;
+  };
+
+  struct LabelStats
+  {
+    std::string label;
+    uint64_t count;
+    int64_t totalNs;
+    int64_t maxNs;
+    int64_t criticalNs;  // part of it on critical paths
+  };
+
+  explicit TaskProfiler(uint32_t eventsPerThread = 1 << 16)
+      : id_{getNextId()}, eventsPerThread_{eventsPerThread}
+  {
+  }
+
+  // instance the task hooks record into
+  static TaskProfiler& global()
+  {
+    static TaskProfiler profiler;
+    return profiler;
+  }
+
+  static int64_t now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // creates the log of the calling thread, threads recording without get "thread <i>"
+  void registerThread(const std::string& name) { getLog().name = name; }
+
+  // the calling thread exits, its log stays for the reads and goes to the next thread registering
+  void unregisterThread()
+  {
+    if(auto log = findLog())
+    {
+      std::lock_guard lock(mutex_);
+      log->thread = {};
+    }
+    threadLog_ = {id_, nullptr};
+  }
+
+  // tasks started from now on belong to the next block
+  void nextBlock() { block_.fetch_add(1, std::memory_order_relaxed); }
+
+  // process wide, stays on until every enable is matched by a disable
+  static void enableLabelTiming() { labelTimingUsers_.fetch_add(1, std::memory_order_relaxed); }
+  static void disableLabelTiming() { labelTimingUsers_.fetch_sub(1, std::memory_order_relaxed); }
+
+  // a static => the task hooks test it without the guard of global()
+  static bool isLabelTiming() { return labelTimingUsers_.load(std::memory_order_relaxed) > 0; }
+
+  // the task hooks time the runs of the calling thread
+  bool isRecording() const { return kTaskProfiling || (isLabelTiming() && findLog() != nullptr); }
+
+  void record(const Task* task,
+              const char* label,
+              int64_t startNs,
+              int64_t endNs,
+              const Task* cause = nullptr)
+  {
+    auto& log = getLog();
+    if(!log.events)
+    {
+      log.events.reset(new Event[eventsPerThread_]);
+    }
+
+    auto size = log.size.load(std::memory_order_relaxed);
+    log.events[size % eventsPerThread_] = {
+        task, cause, label, block_.load(std::memory_order_relaxed), startNs, endNs, log.index};
+    log.size.store(size + 1, std::memory_order_release);
+
+    recordLabel(label, endNs - startNs);
+  }
+
+  // run time of one task run, labels beyond kMaxLabels and threads without a log are not counted
+  void recordLabel(const char* label, int64_t ns)
+  {
+    auto log = findLog();
+    if(log == nullptr)
+    {
+      return;
+    }
+
+    label = label ? label : kUnlabeled;
+
+    // single writer per thread => plain load + store, the atomics are for the readers
+    for(auto& time : log->labels)
+    {
+      auto slot = time.label.load(std::memory_order_relaxed);
+      if(slot == nullptr)
+      {
+        time.label.store(label, std::memory_order_release);
+      }
+      else if(slot != label)
+      {
+        continue;
+      }
+
+      time.count.store(time.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      time.totalNs.store(time.totalNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+      if(ns > time.maxNs.load(std::memory_order_relaxed))
+      {
+        time.maxNs.store(ns, std::memory_order_relaxed);
+      }
+      return;
+    }
+  }
+
+  // sums per label of all threads so far, most time first (criticalNs is 0), any thread
+  std::vector<LabelStats> getLabelTimes() const
+  {
+    std::map<std::string, LabelStats> stats;
+
+    {
+      std::lock_guard lock(mutex_);
+      for(auto& log : logs_)
+      {
+        for(auto& time : log->labels)
+        {
+          auto label = time.label.load(std::memory_order_acquire);
+          if(label == nullptr)
+          {
+            break;
+          }
+
+          auto& s = stats.try_emplace(label, LabelStats{label, 0, 0, 0, 0}).first->second;
+          s.count += time.count.load(std::memory_order_relaxed);
+          s.totalNs += time.totalNs.load(std::memory_order_relaxed);
+          s.maxNs = std::max<int64_t>(s.maxNs, time.maxNs.load(std::memory_order_relaxed));
+        }
+      }
+    }
+
+    std::vector<LabelStats> result;
+    for(auto& [label, s] : stats)
+    {
+      result.push_back(s);
+    }
+
+    std::sort(result.begin(), result.end(), [](auto& a, auto& b) { return a.totalNs > b.totalNs; });
+    return result;
+  }
+
+  // events still in the rings, by start time
+  std::vector<Event> getEvents() const
+  {
+    uint64_t firstCompleteBlock;
+    return getEvents(firstCompleteBlock);
+  }
+
+  void clear()
+  {
+    std::lock_guard lock(mutex_);
+    for(auto& log : logs_)
+    {
+      log->size.store(0, std::memory_order_relaxed);
+      for(auto& time : log->labels)
+      {
+        time.count.store(0, std::memory_order_relaxed);
+        time.totalNs.store(0, std::memory_order_relaxed);
+        time.maxNs.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // complete events ("ph": "X") on one track per thread
+  void writeChromeTrace(std::ostream& out) const
+  {
+    auto events = getEvents();
+    auto origin = events.size() > 0 ? events.front().startNs : 0;
+
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+
+    {
+      std::lock_guard lock(mutex_);
+      for(auto& log : logs_)
+      {
+        out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << log->index
+            << ", \"args\": {\"name\": \"" << log->name << "\"}},\n";
+      }
+    }
+
+    for(uint32_t i{0}; i < events.size(); ++i)
+    {
+      auto& e = events[i];
+      out << "{\"name\": \"" << (e.label ? e.label : kUnlabeled) << "\", \"cat\": \"task\", \"ph\": \"X\""
+          << ", \"pid\": 1, \"tid\": " << e.thread << ", \"ts\": " << (e.startNs - origin) * 1e-3
+          << ", \"dur\": " << (e.endNs - e.startNs) * 1e-3 << ", \"args\": {\"block\": " << e.block << "}}"
+          << (i + 1 < events.size() ? ",\n" : "\n");
+    }
+
+    out << "]}\n";
+  }
+
+  // one path per block with all its events still in the rings
+  std::vector<CriticalPath> getCriticalPaths() const
+  {
+    uint64_t firstCompleteBlock;
+    std::map<uint64_t, std::unordered_map<const Task*, Event>> blocks;
+    for(auto& e : getEvents(firstCompleteBlock))
+    {
+      if(e.block >= firstCompleteBlock)
+      {
+        blocks[e.block][e.task] = e;
+      }
+    }
+
+    std::vector<CriticalPath> paths;
+    for(auto& [block, events] : blocks)
+    {
+      auto first = std::min_element(events.begin(), events.end(), [](auto& a, auto& b) {
+        return a.second.startNs < b.second.startNs;
+      });
+      auto last = std::max_element(events.begin(), events.end(), [](auto& a, auto& b) {
+        return a.second.endNs < b.second.endNs;
+      });
+
+      CriticalPath path{block, last->second.endNs - first->second.startNs, 0, {}};
+      for(const Event* e = &last->second; e != nullptr;)
+      {
+        path.tasks.insert(path.tasks.begin(), *e);
+        path.lengthNs += e->endNs - e->startNs;
+
+        auto cause = e->cause ? events.find(e->cause) : events.end();
+        e = cause != events.end() ? &cause->second : nullptr;
+      }
+
+      paths.push_back(std::move(path));
+    }
+
+    return paths;
+  }
+
+  // run time per label, the ones dominating the critical path first
+  std::vector<LabelStats> getLabelStats() const
+  {
+    std::map<std::string, LabelStats> stats;
+    auto getStats = [&stats](const Event& e) -> LabelStats& {
+      std::string label = e.label ? e.label : kUnlabeled;
+      return stats.try_emplace(label, LabelStats{label, 0, 0, 0, 0}).first->second;
+    };
+
+    for(auto& e : getEvents())
+    {
+      auto& s = getStats(e);
+      ++s.count;
+      s.totalNs += e.endNs - e.startNs;
+      s.maxNs = std::max(s.maxNs, e.endNs - e.startNs);
+    }
+
+    for(auto& path : getCriticalPaths())
+    {
+      for(auto& e : path.tasks)
+      {
+        getStats(e).criticalNs += e.endNs - e.startNs;
+      }
+    }
+
+    std::vector<LabelStats> result;
+    for(auto& [label, s] : stats)
+    {
+      result.push_back(s);
+    }
+
+    std::sort(result.begin(), result.end(), [](auto& a, auto& b) { return a.criticalNs > b.criticalNs; });
+    return result;
+  }
+
+  static constexpr uint32_t kMaxLabels = 32;
+
+protected:
+  static constexpr char kUnlabeled[] = "task";
+
+  struct LabelTime
+  {
+    std::atomic<const char*> label{nullptr};
+    std::atomic<uint64_t> count{0};
+    std::atomic<int64_t> totalNs{0};
+    std::atomic<int64_t> maxNs{0};
+  };
+
+  struct ThreadLog
+  {
+    uint32_t index;
+    std::thread::id thread;
+    std::string name;
+    std::unique_ptr<Event[]> events;  // allocated by the first record
+    std::atomic<uint64_t> size{0};
+    std::array<LabelTime, kMaxLabels> labels;
+  };
+
+  // blocks before firstCompleteBlock lost events to a ring that wrapped
+  std::vector<Event> getEvents(uint64_t& firstCompleteBlock) const
+  {
+    std::vector<Event> events;
+    firstCompleteBlock = 0;
+
+    std::lock_guard lock(mutex_);
+    for(auto& log : logs_)
+    {
+      auto size = log->size.load(std::memory_order_acquire);
+      auto first = size - std::min<uint64_t>(size, eventsPerThread_);
+      for(auto i = first; i < size; ++i)
+      {
+        events.push_back(log->events[i % eventsPerThread_]);
+      }
+
+      // the block of the oldest event left may have earlier ones overwritten
+      if(first > 0)
+      {
+        firstCompleteBlock = std::max(firstCompleteBlock, events[events.size() - (size - first)].block + 1);
+      }
+    }
+
+    std::sort(events.begin(), events.end(), [](auto& a, auto& b) { return a.startNs < b.startNs; });
+    return events;
+  }
+
+  // log of the calling thread or nullptr, looked up once per thread and profiler
+  ThreadLog* findLog() const
+  {
+    // by id => a profiler created at the address of a destroyed one is not mistaken for it
+    if(threadLog_.profiler != id_)
+    {
+      std::lock_guard lock(mutex_);
+      auto log = std::find_if(logs_.begin(), logs_.end(), [](auto& log) {
+        return log->thread == std::this_thread::get_id();
+      });
+      threadLog_ = {id_, log != logs_.end() ? log->get() : nullptr};
+    }
+
+    return threadLog_.log;
+  }
+
+  ThreadLog& getLog()
+  {
+    if(auto log = findLog())
+    {
+      return *log;
+    }
+
+    std::lock_guard lock(mutex_);
+    auto free = std::find_if(
+        logs_.begin(), logs_.end(), [](auto& log) { return log->thread == std::thread::id{}; });
+    if(free == logs_.end())
+    {
+      uint32_t index = logs_.size();
+      logs_.push_back(std::make_unique<ThreadLog>());
+      free = logs_.end() - 1;
+      (*free)->index = index;
+    }
+
+    auto log = free->get();
+    log->thread = std::this_thread::get_id();
+    log->name = "thread " + std::to_string(log->index);
+    threadLog_ = {id_, log};
+    return *log;
+  }
+
+  static uint64_t getNextId()
+  {
+    static std::atomic<uint64_t> nextId{0};
+    return nextId++;
+  }
+
+  uint64_t id_;
+  uint32_t eventsPerThread_;
+  std::atomic<uint64_t> block_{0};
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadLog>> logs_;
+
+  struct CachedLog
+  {
+    uint64_t profiler;
+    ThreadLog* log;
+  };
+
+  static inline thread_local CachedLog threadLog_{~0ULL, nullptr};
+  static inline std::atomic<uint32_t> labelTimingUsers_{0};
+};
@@ -1,14 +1,20 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <semaphore>
 #include <thread>
 #include <vector>
 
-#include "thread_safe_list.h"
+#include "mpmc_queue.h"
+#include "spin_wait.h"
+#include "task_profiler.h"
+#include "thread_config.h"
+#include "work_stealing_deque.h"
 
 class Artifact
 {
@@ -27,12 +33,16 @@ protected:
   T data_;
 };
 
-class Task : public std::enable_shared_from_this<Task>, public ThreadSafeList::Node
+class Task : public std::enable_shared_from_this<Task>
 {
 public:
   void execute(const std::function<void(std::shared_ptr<Task>)>& dep_resolved)
   {
-    callback_(*this);  // Execute the task
+    runWithHooks();  // Execute the task
+
+    // reset dependencies count before any dependent is resolved: once the last one is the
+    // next block may already start and decrement it again
+    dependenciesLeft_ = dependencies_.size();
 
     for(auto& d : dependents_)
     {
@@ -41,12 +51,49 @@ public:
         dep_resolved(d);
       }
     }
+  }
 
-    // reset dependencies count
-    dependenciesLeft_ = dependencies_.size();
+  // callback only, dependencies are tracked by the caller (see StaticSchedule)
+  void run() { callback_(*this); }
+
+  // callback with the profiler hooks: recorded with DXO_PROFILE, timed per label while label
+  // timing is on, otherwise one relaxed load
+  void runWithHooks()
+  {
+    if constexpr(kTaskProfiling)
+    {
+      // the dependencies of this block are done and do not run again before this one is
+      auto cause = getLastDependency();
+      auto start = TaskProfiler::now();
+      callback_(*this);
+      auto end = TaskProfiler::now();
+
+      endNs_.store(end, std::memory_order_relaxed);
+      TaskProfiler::global().record(this, label_, start, end, cause);
+    }
+    else if(TaskProfiler::isLabelTiming() && TaskProfiler::global().isRecording())
+    {
+      auto start = TaskProfiler::now();
+      callback_(*this);
+      TaskProfiler::global().recordLabel(label_, TaskProfiler::now() - start);
+    }
+    else
+    {
+      callback_(*this);
+    }
+  }
+
+  // name in profiles, must outlive the task (e.g. a literal)
+  std::shared_ptr<Task> setLabel(const char* label)
+  {
+    label_ = label;
+    return shared_from_this();
   }
 
+  const char* getLabel() const { return label_; }
+
   const std::vector<std::shared_ptr<Task>>& getDependencies() const { return dependencies_; }
+  const std::vector<std::shared_ptr<Task>>& getDependents() const { return dependents_; }
 
   template <typename T>
   T& getArtifact()
@@ -64,6 +111,23 @@ public:
 
   bool isFinal() const { return dependents_.size() == 0; }
 
+  // dependency whose last recorded run finished last
+  const Task* getLastDependency() const
+  {
+    const Task* last = nullptr;
+    int64_t lastEndNs{0};
+    for(auto& d : dependencies_)
+    {
+      auto endNs = d->endNs_.load(std::memory_order_relaxed);
+      if(last == nullptr || endNs > lastEndNs)
+      {
+        last = d.get();
+        lastEndNs = endNs;
+      }
+    }
+    return last;
+  }
+
   template <typename ArtifactType>
   static std::shared_ptr<Task> create(const std::function<void(Task&)>& callback,
                                       const std::vector<std::shared_ptr<Task>>& dependencies = {},
@@ -81,11 +145,6 @@ public:
     return task;
   }
 
-  static std::shared_ptr<Task> fromNode(ThreadSafeList::Node* node)
-  {
-    return static_cast<Task*>(node)->getSharedPointer();
-  }
-
 protected:
   Task(std::function<void(Task&)> task,
        const std::vector<std::shared_ptr<Task>>& dependencies,
@@ -100,32 +159,55 @@ protected:
   {
   }
 
-  std::shared_ptr<Task> getSharedPointer() { return shared_from_this(); }
-
   std::function<void(Task&)> callback_;
   std::vector<std::shared_ptr<Task>> dependencies_;
   std::atomic<uint32_t> dependenciesLeft_{0};      // Number of dependencies yet to complete
   std::vector<std::shared_ptr<Task>> dependents_;  // Tasks that depend on this one
   std::unique_ptr<Artifact> artifact_{nullptr};
   std::function<void()> reset_{};
+  const char* label_{nullptr};
+  std::atomic<int64_t> endNs_{0};  // end of the last recorded run
 };
 
+// Work stealing scheduler: each worker owns a Chase-Lev deque. Tasks made ready by a
+// worker go to its own deque (LIFO, cache friendly), idle workers steal from the others.
+// Root tasks submitted by run() are injected through a bounded MPMC ring.
+//
+// Idle workers spin shortly before they block (the next task of a block usually follows
+// within microseconds). Between blocks they park until shortly before the next block is
+// expected and spin across its start, so the inputs are picked up without a futex wake up.
 class TaskRunner
 {
 public:
+  struct WaitStats
+  {
+    uint64_t spinHits;  // idle worker found work while spinning
+    uint64_t sleeps;    // idle worker had to be woken up through the condition variable
+  };
+
   explicit TaskRunner(uint32_t numThreads)
   {
+    spinTime_ = getDefaultSpinTime(numThreads);
+
+    for(uint32_t i = 0; i < numThreads; ++i)
+    {
+      localQueues_.push_back(std::make_unique<LocalQueue>(i));
+    }
+
     for(uint32_t i = 0; i < numThreads; ++i)
     {
-      workers_.emplace_back([this] { threadRun(); });
+      workers_.emplace_back([this, i] {
+        TaskProfiler::global().registerThread("worker " + std::to_string(i));
+        threadRun(*localQueues_[i]);
+        TaskProfiler::global().unregisterThread();
+      });
     }
   }
 
   ~TaskRunner()
   {
     stop_.store(true);
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
-    cv_.notify_all();
+    wakeWorkers(workers_.size());
 
     for(auto& worker : workers_)
     {
@@ -136,9 +218,39 @@ public:
     }
   }
 
+  // returns 0 or the first error (errno value)
+  int configure(const ThreadConfig& config)
+  {
+    if(config.spinTime)
+    {
+      setSpinTime(*config.spinTime);
+    }
+
+    return config.apply(workers_);
+  }
+
+  // idle workers poll this long before they block, 0 => block at once
+  void setSpinTime(std::chrono::nanoseconds spinTime)
+  {
+    spinTime_.store(spinTime, std::memory_order_relaxed);
+  }
+
+  WaitStats getWaitStats() const
+  {
+    return {spinHits_.load(std::memory_order_relaxed), sleeps_.load(std::memory_order_relaxed)};
+  }
+
+  // per worker
+  std::vector<std::chrono::nanoseconds> getCpuTimes() { return ::getCpuTimes(workers_); }
+
   void run(const std::vector<std::shared_ptr<Task>>& tasks, bool wait = true)
   {
-    std::shared_ptr<Task> finalTask{nullptr};
+    if(wait)
+    {
+      predictNextBlock();
+    }
+
+    uint32_t numRootTasks{0};
 
     for(auto& task : tasks)
     {
@@ -149,15 +261,20 @@ public:
 
       if(task->getDependencies().size() == 0)
       {
-        activeTasks_.push(task.get());
+        // full => workers drain it
+        while(!injectedTasks_.push(task.get()))
+        {
+          wakeWorkers(workers_.size());
+          std::this_thread::yield();
+        }
+        ++numRootTasks;
       }
     }
 
-    restartWorker();
+    wakeWorkers(numRootTasks);
 
     if(finalTask_ && wait)
     {
-      // threadRun(true);
       finalTaskReady_.acquire();
       finalTask_->execute(nullptr);
       finalTask_ = nullptr;
@@ -165,55 +282,205 @@ public:
   }
 
 protected:
-  void restartWorker()
+  static constexpr uint32_t kMaxInjectedTasks = 1024;
+
+  struct LocalQueue
+  {
+    explicit LocalQueue(uint32_t i) : index{i} {}
+
+    uint32_t index;
+    WorkStealingDeque<Task*> tasks;
+    uint32_t numPushed{0};
+  };
+
+  Task* findTask(LocalQueue& local)
   {
-    ++epoch_;
-    cv_.notify_all();
+    if(auto task = local.tasks.pop())
+    {
+      return task;
+    }
+
+    if(auto task = injectedTasks_.pop())
+    {
+      return task;
+    }
+
+    // steal starting at the right neighbour to spread thieves over all victims
+    for(uint32_t i{1}; i < localQueues_.size(); ++i)
+    {
+      if(auto task = localQueues_[(local.index + i) % localQueues_.size()]->tasks.steal())
+      {
+        return task;
+      }
+    }
+
+    return nullptr;
   }
 
-  void threadRun()
+  bool hasWork() const
+  {
+    for(auto& q : localQueues_)
+    {
+      if(!q->tasks.empty())
+      {
+        return true;
+      }
+    }
+
+    return !injectedTasks_.empty();
+  }
+
+  void threadRun(LocalQueue& local)
   {
     while(!stop_.load())
     {
-      const auto epoch = epoch_.load();
-      auto task = activeTasks_.pop();
+      auto task = findTask(local);
 
       if(task == nullptr)
       {
-        std::unique_lock lock(mutex_);
-        cv_.wait(lock, [this, epoch]() { return epoch != epoch_ || stop_; });
+        sleep();
+        continue;
       }
-      else
-      {
-        auto listWasEmpty = false;
-        Task::fromNode(task)->execute([this, &listWasEmpty](std::shared_ptr<Task> task) {
-          if(!task->isFinal())
-          {
-            if(activeTasks_.push(task.get()))
-            {
-              listWasEmpty = true;
-            }
-          }
-          else
-          {
-            finalTaskReady_.release();
-          }
-        });
-
-        if(listWasEmpty)
+
+      local.numPushed = 0;
+      task->execute([this, &local](std::shared_ptr<Task> task) {
+        if(!task->isFinal())
+        {
+          local.tasks.push(task.get());
+          ++local.numPushed;
+        }
+        else
         {
-          restartWorker();
+          finalTaskReady_.release();
         }
+      });
+
+      // this worker continues with one of them => wake others for the rest only
+      if(local.numPushed > 1)
+      {
+        wakeWorkers(local.numPushed - 1);
+      }
+    }
+  }
+
+  // inputs of a new block arrive => expect the next one a block period later
+  void predictNextBlock()
+  {
+    auto now = std::chrono::steady_clock::now();
+
+    if(lastBlock_.time_since_epoch().count() > 0)
+    {
+      auto period = now - lastBlock_;
+      blockPeriod_ = blockPeriod_.count() == 0 ? period : blockPeriod_ + (period - blockPeriod_) / 8;
+    }
+
+    lastBlock_ = now;
+    nextBlock_.store(now + blockPeriod_, std::memory_order_relaxed);
+  }
+
+  void sleep()
+  {
+    auto spinTime = spinTime_.load(std::memory_order_relaxed);
+    auto hasWorkOrStop = [this] { return hasWork() || stop_.load(std::memory_order_relaxed); };
+
+    if(spinFor(hasWorkOrStop, spinTime))
+    {
+      spinHits_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    // park until shortly before the next block, then spin across its start
+    auto wakeup = nextBlock_.load(std::memory_order_relaxed) - spinTime;
+    if(spinTime.count() > 0 && wakeup > std::chrono::steady_clock::now())
+    {
+      if(park(wakeup))
+      {
+        return;
       }
+
+      if(spinFor(hasWorkOrStop, 2 * spinTime))
+      {
+        spinHits_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+
+    park(std::chrono::steady_clock::time_point::max());
+  }
+
+  // returns false if the deadline passed without a wake up
+  bool park(std::chrono::steady_clock::time_point deadline)
+  {
+    const auto epoch = epoch_.load();
+    ++numSleeping_;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // recheck after announcing => a concurrent push either sees us sleeping or we see its task
+    bool woken{true};
+    if(!hasWork())
+    {
+      auto isWoken = [this, epoch]() { return epoch != epoch_.load() || stop_; };
+
+      std::unique_lock lock(mutex_);
+      if(deadline == std::chrono::steady_clock::time_point::max())
+      {
+        cv_.wait(lock, isWoken);
+      }
+      else
+      {
+        woken = cv_.wait_until(lock, deadline, isWoken);
+      }
+
+      if(woken)
+      {
+        sleeps_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    --numSleeping_;
+    return woken;
+  }
+
+  void wakeWorkers(uint32_t count)
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if(numSleeping_.load() == 0 && !stop_.load())
+    {
+      return;
+    }
+
+    {
+      std::lock_guard lock(mutex_);
+      ++epoch_;
+    }
+
+    if(count >= workers_.size())
+    {
+      cv_.notify_all();
+      return;
+    }
+
+    for(uint32_t i{0}; i < count; ++i)
+    {
+      cv_.notify_one();
     }
   }
 
   std::mutex mutex_;
   std::condition_variable cv_;
-  ThreadSafeList activeTasks_;
+  MpmcQueue<Task*> injectedTasks_{kMaxInjectedTasks};
+  std::vector<std::unique_ptr<LocalQueue>> localQueues_;
   std::vector<std::thread> workers_;
   std::atomic<bool> stop_{false};
   std::binary_semaphore finalTaskReady_{0};
   std::shared_ptr<Task> finalTask_{nullptr};
   std::atomic<uint64_t> epoch_{0};
+  std::atomic<uint32_t> numSleeping_{0};
+  std::atomic<std::chrono::nanoseconds> spinTime_{};
+  std::atomic<std::chrono::steady_clock::time_point> nextBlock_{};
+  std::chrono::steady_clock::time_point lastBlock_{};  // caller of run() only
+  std::chrono::nanoseconds blockPeriod_{0};
+  std::atomic<uint64_t> spinHits_{0};
+  std::atomic<uint64_t> sleeps_{0};
 };
@@ -3,8 +3,11 @@
 #include <chrono>
 #include <cstdlib>
 #include <iostream>
+#include <sstream>
 #include <thread>
 
+#include "static_schedule.h"
+#include "task_profiler.h"
 #include "tasks.h"
 
 class TaskTest : public testing::Test
@@ -87,4 +90,372 @@ TEST_F(TaskTest, Test_TaskRunningOrder)
   runner_.run(tasks_);
 
   EXPECT_EQ(tasks_[35]->getArtifact<ArtifactType>()[0], 650.0f);
-}
\ No newline at end of file
+}
+
+// Same shape as the crossover graph: background tasks start before the inputs of the block
+// are ready, the foreground run waits for the final task. Every task checks it sees the
+// results of its dependencies for the current block.
+class BlockGraph
+{
+public:
+  static constexpr uint32_t kNumInputs = 3;
+  static constexpr uint32_t kNumFilters = 7;
+
+  BlockGraph()
+  {
+    for(uint32_t i{0}; i < kNumInputs; ++i)
+    {
+      inputJobs_.push_back(
+          Task::create<uint64_t>([this](Task& task) { task.getArtifact<uint64_t>() = block_; }, {}, 0));
+    }
+
+    auto root = Task::create<uint64_t>([this](Task& task) { task.getArtifact<uint64_t>() = block_; }, {}, 0);
+    backgroundJobs_.push_back(root);
+
+    std::vector<std::shared_ptr<Task>> results;
+    for(uint32_t i{0}; i < kNumFilters; ++i)
+    {
+      // partial sums independent from the input, combine needs the input
+      auto partial = Task::create<uint64_t>(
+          [](Task& task) {
+            task.getArtifact<uint64_t>() = task.getDependencies()[0]->getArtifact<uint64_t>();
+          },
+          {root},
+          0);
+
+      auto combine = Task::create<uint64_t>(
+          [this](Task& task) {
+            auto input = task.getDependencies()[0]->getArtifact<uint64_t>();
+            auto partial = task.getDependencies()[1]->getArtifact<uint64_t>();
+            errors_ += input != partial;
+            task.getArtifact<uint64_t>() = input + partial;
+          },
+          {inputJobs_[i % kNumInputs], partial},
+          0);
+
+      results.push_back(combine);
+    }
+
+    final_ = Task::create<uint64_t>(
+        [](Task& task) {
+          uint64_t sum{0};
+          for(auto& d : task.getDependencies())
+          {
+            sum += d->getArtifact<uint64_t>();
+          }
+          task.getArtifact<uint64_t>() = sum;
+        },
+        results,
+        0);
+    backgroundJobs_.push_back(final_);
+  }
+
+  // result of the block just finished
+  bool check() { return final_->getArtifact<uint64_t>() == 2 * kNumFilters * block_ && errors_ == 0; }
+
+  static uint64_t getIterations()
+  {
+    auto env = std::getenv("DXO_STRESS_ITERATIONS");
+    return env ? std::stoul(env) : 20000;
+  }
+
+  std::vector<std::shared_ptr<Task>> inputJobs_;
+  std::vector<std::shared_ptr<Task>> backgroundJobs_;
+  std::shared_ptr<Task> final_;
+  std::atomic<uint32_t> errors_{0};
+  uint64_t block_{0};
+};
+
+// Run the test binary built with -fsanitize=thread (DXO_TSAN) and
+// DXO_STRESS_ITERATIONS=2000000 to hunt for races.
+TEST_F(TaskTest, Test_BlockLoopStress)
+{
+  BlockGraph graph;
+  runner_.run(graph.backgroundJobs_, false);
+
+  for(uint64_t i{0}; i < BlockGraph::getIterations(); ++i)
+  {
+    runner_.run(graph.inputJobs_);
+    ASSERT_TRUE(graph.check()) << " block " << graph.block_;
+
+    ++graph.block_;
+    runner_.run(graph.backgroundJobs_, false);
+  }
+
+  // drain the background run before the graph goes away
+  runner_.run(graph.inputJobs_);
+}
+
+TEST_F(TaskTest, Test_StaticSchedule)
+{
+  BlockGraph graph;
+  auto costs = StaticSchedule::measure(graph.inputJobs_, 4);
+  EXPECT_EQ(costs.size(), 1 + BlockGraph::kNumInputs + 2 * BlockGraph::kNumFilters + 1);
+
+  StaticSchedule schedule(graph.inputJobs_, graph.backgroundJobs_, 3, costs);
+
+  uint32_t numTasks{0};
+  for(auto& list : schedule.getLists())
+  {
+    EXPECT_GT(list.size(), 0);
+    numTasks += list.size();
+  }
+  EXPECT_EQ(numTasks, costs.size());
+
+  graph.block_ = 0;
+  schedule.startBlock();
+
+  for(uint64_t i{0}; i < BlockGraph::getIterations(); ++i)
+  {
+    schedule.finishBlock();
+    ASSERT_TRUE(graph.check()) << " block " << graph.block_;
+
+    ++graph.block_;
+    schedule.startBlock();
+  }
+
+  schedule.finishBlock();
+}
+
+TEST_F(TaskTest, Test_ThreadConfig)
+{
+  auto cpus = ThreadConfig::parseCpus("0 1,3 4-6,8");
+  ASSERT_EQ(cpus.size(), 3);
+  EXPECT_EQ(cpus[0], (std::vector<uint32_t>{0}));
+  EXPECT_EQ(cpus[1], (std::vector<uint32_t>{1, 3}));
+  EXPECT_EQ(cpus[2], (std::vector<uint32_t>{4, 5, 6, 8}));
+  EXPECT_TRUE(ThreadConfig::parseCpus("").empty());
+  EXPECT_THROW(ThreadConfig::parseCpus("x"), std::invalid_argument);
+
+  // pin all workers to the first cpu, blocks still complete
+  ThreadConfig config;
+  config.cpus = {{0}};
+  EXPECT_FALSE(config.isDefault());
+
+  TaskRunner runner{2};
+  EXPECT_EQ(runner.configure(config), 0);
+
+  BlockGraph graph;
+  runner.run(graph.backgroundJobs_, false);
+  for(uint32_t i{0}; i < 100; ++i)
+  {
+    runner.run(graph.inputJobs_);
+    ASSERT_TRUE(graph.check()) << " block " << graph.block_;
+
+    ++graph.block_;
+    runner.run(graph.backgroundJobs_, false);
+  }
+
+  runner.run(graph.inputJobs_);
+}
+
+// idle gaps between blocks, returns the wait statistics collected during them
+static TaskRunner::WaitStats runBlocks(TaskRunner& runner,
+                                       BlockGraph& graph,
+                                       const std::vector<std::chrono::microseconds>& gaps)
+{
+  auto before = runner.getWaitStats();
+
+  for(auto gap : gaps)
+  {
+    std::this_thread::sleep_for(gap);
+
+    runner.run(graph.inputJobs_);
+    EXPECT_TRUE(graph.check()) << " block " << graph.block_;
+
+    ++graph.block_;
+    runner.run(graph.backgroundJobs_, false);
+  }
+
+  auto after = runner.getWaitStats();
+  return {after.spinHits - before.spinHits, after.sleeps - before.sleeps};
+}
+
+TEST_F(TaskTest, Test_SpinThenBlock)
+{
+  using namespace std::chrono_literals;
+
+  BlockGraph graph;
+  TaskRunner runner{2};
+  runner.run(graph.backgroundJobs_, false);
+
+  // gap well within the spin budget => the next block is picked up by spinning workers
+  runner.setSpinTime(20ms);
+  runBlocks(runner, graph, {0us, 0us});  // workers leave the initial park
+  auto spinning = runBlocks(runner, graph, std::vector<std::chrono::microseconds>(50, 50us));
+  EXPECT_GT(spinning.spinHits, 0);
+
+  // idle gaps far beyond the spin budget and the predicted block start => workers park
+  runner.setSpinTime(50us);
+  std::vector<std::chrono::microseconds> gaps;
+  for(uint32_t i{0}; i < 20; ++i)
+  {
+    gaps.push_back(i % 2 ? 5ms : 0ms);
+  }
+  auto idle = runBlocks(runner, graph, gaps);
+  EXPECT_GT(idle.sleeps, 0);
+
+  runner.run(graph.inputJobs_);
+}
+
+TEST_F(TaskTest, Test_ProfilerCriticalPath)
+{
+  // fft => slow and fast multiply => combine, the slow one decides the block
+  auto fft = Task::create<int>([](Task&) {})->setLabel("fft");
+  auto slow = Task::create<int>([](Task&) {}, {fft})->setLabel("slow");
+  auto fast = Task::create<int>([](Task&) {}, {fft})->setLabel("fast");
+  auto combine = Task::create<int>([](Task&) {}, {slow, fast})->setLabel("combine");
+
+  TaskProfiler profiler;
+  for(uint32_t block{0}; block < 2; ++block)
+  {
+    profiler.nextBlock();
+
+    int64_t t = 1000 * block;
+    profiler.record(fft.get(), fft->getLabel(), t, t + 10);
+    std::thread([&] {
+      profiler.registerThread("worker");
+      profiler.record(slow.get(), slow->getLabel(), t + 15, t + 60, fft.get());
+    }).join();
+    profiler.record(fast.get(), fast->getLabel(), t + 12, t + 20, fft.get());
+    profiler.record(combine.get(), combine->getLabel(), t + 70, t + 80, slow.get());
+  }
+
+  auto paths = profiler.getCriticalPaths();
+  ASSERT_EQ(paths.size(), 2);
+  EXPECT_EQ(paths[1].block, 2);
+  EXPECT_EQ(paths[1].wallNs, 80);
+  EXPECT_EQ(paths[1].lengthNs, 10 + 45 + 10);
+
+  std::vector<std::string> labels;
+  for(auto& e : paths[1].tasks)
+  {
+    labels.push_back(e.label);
+  }
+  EXPECT_EQ(labels, (std::vector<std::string>{"fft", "slow", "combine"}));
+
+  auto stats = profiler.getLabelStats();
+  ASSERT_EQ(stats.size(), 4);
+  EXPECT_EQ(stats[0].label, "slow");
+  EXPECT_EQ(stats[0].count, 2);
+  EXPECT_EQ(stats[0].criticalNs, 90);
+  EXPECT_EQ(stats.back().label, "fast");
+  EXPECT_EQ(stats.back().criticalNs, 0);
+
+  std::ostringstream trace;
+  profiler.writeChromeTrace(trace);
+  EXPECT_NE(trace.str().find("\"name\": \"worker\""), std::string::npos);
+  EXPECT_NE(trace.str().find("{\"name\": \"slow\", \"cat\": \"task\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1"),
+            std::string::npos);
+
+  profiler.clear();
+  EXPECT_EQ(profiler.getEvents().size(), 0);
+}
+
+TEST_F(TaskTest, Test_ProfilerWrappedRing)
+{
+  auto fft = Task::create<int>([](Task&) {})->setLabel("fft");
+  auto combine = Task::create<int>([](Task&) {}, {fft})->setLabel("combine");
+
+  // 3 blocks of 2 events in a ring of 5: the first event of block 1 is overwritten
+  TaskProfiler profiler(5);
+  for(uint32_t block{0}; block < 3; ++block)
+  {
+    profiler.nextBlock();
+
+    int64_t t = 1000 * block;
+    profiler.record(fft.get(), fft->getLabel(), t, t + 10);
+    profiler.record(combine.get(), combine->getLabel(), t + 10, t + 20, fft.get());
+  }
+
+  EXPECT_EQ(profiler.getEvents().size(), 5);
+
+  auto paths = profiler.getCriticalPaths();
+  ASSERT_EQ(paths.size(), 2);
+  EXPECT_EQ(paths[0].block, 2);
+  EXPECT_EQ(paths[0].tasks.size(), 2);
+  EXPECT_EQ(paths[1].block, 3);
+}
+
+// configure with -DDXO_PROFILE=ON
+TEST_F(TaskTest, Test_ProfilerHooks)
+{
+  if constexpr(!kTaskProfiling)
+  {
+    GTEST_SKIP() << "task profiling compiled out";
+  }
+
+  auto& profiler = TaskProfiler::global();
+  profiler.clear();
+
+  // like the crossover: the block starts before its background jobs
+  BlockGraph graph;
+  for(uint32_t i{0}; i < 10; ++i)
+  {
+    profiler.nextBlock();
+    runner_.run(graph.backgroundJobs_, false);
+    runner_.run(graph.inputJobs_);
+    ++graph.block_;
+  }
+
+  // every task of a block recorded once, the path ends in the final task
+  auto paths = profiler.getCriticalPaths();
+  ASSERT_EQ(paths.size(), 10);
+  EXPECT_EQ(paths[5].tasks.back().task, graph.final_.get());
+  EXPECT_EQ(paths[5].tasks.front().cause, nullptr);
+  for(uint32_t i{1}; i < paths[5].tasks.size(); ++i)
+  {
+    EXPECT_EQ(paths[5].tasks[i].cause, paths[5].tasks[i - 1].task);
+  }
+  EXPECT_GE(paths[5].wallNs, paths[5].lengthNs);
+  EXPECT_EQ(profiler.getEvents().size(), 10 * (1 + 3 + 2 * 7 + 1));
+}
+
+TEST_F(TaskTest, Test_LabelTiming)
+{
+  auto& profiler = TaskProfiler::global();
+  profiler.clear();
+  profiler.enableLabelTiming();
+  profiler.enableLabelTiming();
+
+  // the final task runs on a thread without a log (like the audio thread) => not timed
+  std::thread([&] {
+    BlockGraph graph;
+    graph.final_->setLabel("final");
+    for(auto i{0}; i < 3; ++i)
+    {
+      runner_.run(graph.backgroundJobs_, false);
+      runner_.run(graph.inputJobs_);
+      ++graph.block_;
+    }
+    if constexpr(!kTaskProfiling)
+    {
+      EXPECT_FALSE(profiler.isRecording());
+    }
+  }).join();
+
+  // readable while the workers run, unlabeled tasks are summed up as "task"
+  auto times = profiler.getLabelTimes();
+  auto final = std::find_if(times.begin(), times.end(), [](auto& t) { return t.label == "final"; });
+  EXPECT_EQ(final != times.end(), kTaskProfiling);
+
+  auto unlabeled = std::find_if(times.begin(), times.end(), [](auto& t) { return t.label == "task"; });
+  ASSERT_NE(unlabeled, times.end());
+  EXPECT_EQ(unlabeled->count, 3 * (1 + 3 + 2 * 7));
+  EXPECT_GE(unlabeled->totalNs, unlabeled->maxNs);
+
+  // on until every user disabled it, checked on a worker
+  bool recording{false};
+  auto check = Task::create<int>([&](Task&) { recording = profiler.isRecording(); });
+  auto done = Task::create<int>([](Task&) {}, {check});
+
+  profiler.disableLabelTiming();
+  runner_.run({check, done});
+  EXPECT_TRUE(recording);
+
+  profiler.disableLabelTiming();
+  runner_.run({check, done});
+  EXPECT_EQ(recording, kTaskProfiling);
+
+  profiler.clear();
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <cerrno>
+#include <chrono>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Scheduling policy, priority, cpu affinity and idle spinning of worker threads.
+//
+// Default is SCHED_OTHER without pinning, i.e. nothing is changed. A realtime policy needs
+// CAP_SYS_NICE or a matching RLIMIT_RTPRIO => apply() reports the error and the threads keep
+// running with their previous settings.
+struct ThreadConfig
+{
+  int policy{SCHED_OTHER};
+  int priority{0};
+  std::vector<std::vector<uint32_t>> cpus;  // worker i runs on cpus[i % size], empty => any cpu
+  std::optional<std::chrono::nanoseconds> spinTime;  // unset => default of the scheduler
+
+  bool isDefault() const { return policy == SCHED_OTHER && cpus.size() == 0 && !spinTime; }
+
+  // returns 0 or the first error (errno value), all threads are tried anyway
+  int apply(std::vector<std::thread>& threads) const
+  {
+    int result{0};
+    for(uint32_t i{0}; i < threads.size(); ++i)
+    {
+      auto error = apply(threads[i].native_handle(), i);
+      result = result != 0 ? result : error;
+    }
+
+    return result;
+  }
+
+  int apply(pthread_t thread, uint32_t index) const
+  {
+    int result{0};
+
+    if(policy != SCHED_OTHER)
+    {
+      sched_param param{};
+      param.sched_priority = priority;
+      result = pthread_setschedparam(thread, policy, &param);
+    }
+
+    if(cpus.size() > 0 && cpus[index % cpus.size()].size() > 0)
+    {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for(auto cpu : cpus[index % cpus.size()])
+      {
+        CPU_SET(cpu, &set);
+      }
+
+      auto error = pthread_setaffinity_np(thread, sizeof(set), &set);
+      result = result != 0 ? result : error;
+    }
+
+    return result;
+  }
+
+  // one mask per worker separated by spaces, each a cpu list like "2,4-5" => "2 3 4-5"
+  static std::vector<std::vector<uint32_t>> parseCpus(const std::string& str)
+  {
+    std::vector<std::vector<uint32_t>> cpus;
+
+    std::istringstream workers{str};
+    std::string mask;
+    while(workers >> mask)
+    {
+      cpus.emplace_back();
+
+      std::istringstream ranges{mask};
+      std::string range;
+      while(std::getline(ranges, range, ','))
+      {
+        auto dash = range.find('-');
+        uint32_t first = std::stoul(range.substr(0, dash));
+        uint32_t last = dash != std::string::npos ? std::stoul(range.substr(dash + 1)) : first;
+
+        for(auto cpu{first}; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+        {
+          cpus.back().push_back(cpu);
+        }
+      }
+    }
+
+    return cpus;
+  }
+};
+
+// cpu time the threads consumed so far, readable from any thread (0 => clock not available)
+inline std::vector<std::chrono::nanoseconds> getCpuTimes(std::vector<std::thread>& threads)
+{
+  std::vector<std::chrono::nanoseconds> times;
+  for(auto& thread : threads)
+  {
+    clockid_t clock;
+    timespec time{};
+    if(pthread_getcpuclockid(thread.native_handle(), &clock) == 0)
+    {
+      clock_gettime(clock, &time);
+    }
+    times.push_back(std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec));
+  }
+
+  return times;
+}
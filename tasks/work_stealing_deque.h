@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Chase-Lev work stealing deque (memory orders as in Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models", PPoPP 2013).
+//
+// The owner pushes and pops at the bottom (LIFO), all other threads steal from the top
+// (FIFO). The ring grows when full; old rings are kept until destruction because a thief
+// may still read from them.
+template <typename T>
+class WorkStealingDeque
+{
+public:
+  explicit WorkStealingDeque(uint32_t capacity = 64)
+  {
+    rings_.push_back(std::make_unique<Ring>(capacity));
+    ring_.store(rings_.back().get(), std::memory_order_relaxed);
+  }
+
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+  // owner only
+  void push(T item)
+  {
+    auto bottom = bottom_.load(std::memory_order_relaxed);
+    auto top = top_.load(std::memory_order_acquire);
+    auto ring = ring_.load(std::memory_order_relaxed);
+
+    if(bottom - top > ring->mask_)
+    {
+      ring = grow(ring, top, bottom);
+    }
+
+    ring->put(bottom, item);
+    bottom_.store(bottom + 1, std::memory_order_release);  // publishes the task to thieves
+  }
+
+  // owner only, returns nullptr if empty
+  T pop()
+  {
+    auto bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    auto ring = ring_.load(std::memory_order_relaxed);
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto top = top_.load(std::memory_order_relaxed);
+
+    if(top > bottom)
+    {
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    auto item = ring->get(bottom);
+    if(top == bottom)
+    {
+      // last item => race against thieves
+      if(!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+      {
+        item = nullptr;
+      }
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    return item;
+  }
+
+  // any thread, returns nullptr if empty or lost against another thread
+  T steal()
+  {
+    auto top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto bottom = bottom_.load(std::memory_order_acquire);
+
+    if(top >= bottom)
+    {
+      return nullptr;
+    }
+
+    auto item = ring_.load(std::memory_order_acquire)->get(top);
+    if(!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+      return nullptr;
+    }
+
+    return item;
+  }
+
+  bool empty() const
+  {
+    return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+  }
+
+protected:
+  struct Ring
+  {
+    explicit Ring(uint32_t capacity) : mask_{capacity - 1}, items_(capacity) {}
+
+    T get(int64_t i) const { return items_[i & mask_].load(std::memory_order_relaxed); }
+    void put(int64_t i, T item) { items_[i & mask_].store(item, std::memory_order_relaxed); }
+
+    int64_t mask_;
+    std::vector<std::atomic<T>> items_;
+  };
+
+  Ring* grow(Ring* ring, int64_t top, int64_t bottom)
+  {
+    rings_.push_back(std::make_unique<Ring>(2 * (ring->mask_ + 1)));
+
+    auto newRing = rings_.back().get();
+    for(auto i{top}; i < bottom; ++i)
+    {
+      newRing->put(i, ring->get(i));
+    }
+
+    ring_.store(newRing, std::memory_order_release);
+    return newRing;
+  }
+
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  std::atomic<Ring*> ring_{nullptr};
+  std::vector<std::unique_ptr<Ring>> rings_;  // owner only
+};
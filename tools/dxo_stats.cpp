@@ -0,0 +1,128 @@
+#include <signal.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "../stats_shm.h"
+
+// Live view of a running plugin, attaches read only to the stats block the plugin publishes
+// with stats_shm "<name>" in its config.
+//
+// usage: dxo_stats [name] [interval ms] [count]   (count 0 => until interrupted)
+static void printTime(const char* name, const LatencyHistogram::Snapshot& time)
+{
+  std::cout << std::left << std::setw(10) << name << std::right << std::setw(10) << time.count;
+  for(auto ns : {static_cast<uint64_t>(time.meanNs()),
+                 time.percentileNs(0.5),
+                 time.percentileNs(0.99),
+                 time.percentileNs(0.999),
+                 time.maxNs})
+  {
+    std::cout << std::setw(9) << ns * 1e-3;
+  }
+  std::cout << "\n";
+}
+
+// runs per block and mean over the interval, max since the export started
+static void printTasks(const DxoStats& stats, const DxoStats& previous)
+{
+  uint64_t blocks = stats.processTime.count - previous.processTime.count;
+
+  std::cout << "[us] task           runs/block     mean      max\n";
+  for(uint32_t i{0}; i < stats.numTasks; ++i)
+  {
+    auto& task = stats.tasks[i];
+
+    uint64_t count = task.count;
+    uint64_t totalNs = task.totalNs;
+    for(uint32_t j{0}; j < previous.numTasks; ++j)
+    {
+      if(std::strcmp(previous.tasks[j].label, task.label) == 0)
+      {
+        count -= previous.tasks[j].count;
+        totalNs -= previous.tasks[j].totalNs;
+      }
+    }
+
+    std::cout << std::left << std::setw(24) << task.label << std::right << std::setw(6)
+              << (blocks > 0 ? static_cast<double>(count) / blocks : 0) << std::setw(9)
+              << (count > 0 ? totalNs * 1e-3 / count : 0) << std::setw(9) << task.maxNs * 1e-3 << "\n";
+  }
+}
+
+static void print(const DxoStats& stats, const DxoStats& previous)
+{
+  double seconds = (stats.timeNs - previous.timeNs) * 1e-9;
+  bool alive = kill(stats.pid, 0) == 0;
+
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "dxo pid " << stats.pid << (alive ? "" : " (gone)") << "  block " << stats.blockSize
+            << "  deadline " << stats.deadlineNs * 1e-3 << " us\n";
+
+  double blocksPerSecond = seconds > 0 ? (stats.processTime.count - previous.processTime.count) / seconds : 0;
+  std::cout << "blocks/s " << blocksPerSecond << "  deadline misses " << stats.deadlineMisses << "  xruns "
+            << stats.xruns << "  recoveries " << stats.recoveries << "\n\n";
+
+  std::cout << "[us]           count     mean      p50      p99    p99.9      max\n";
+  printTime("process", stats.processTime);
+  printTime("write", stats.writeTime);
+  std::cout << "\n";
+
+  for(uint32_t i{0}; i < stats.numWorkers; ++i)
+  {
+    double load = seconds > 0 ? (stats.workerCpuNs[i] - previous.workerCpuNs[i]) * 1e-9 / seconds : 0;
+    std::cout << "worker " << i << std::setw(8) << load * 100 << " % cpu\n";
+  }
+  std::cout << "\n";
+
+  printTasks(stats, previous);
+}
+
+int main(int argc, char* argv[])
+{
+  std::string name = argc > 1 ? argv[1] : "dxo";
+  auto interval = std::chrono::milliseconds(argc > 2 ? std::stoul(argv[2]) : 1000);
+  uint32_t count = argc > 3 ? std::stoul(argv[3]) : 0;
+
+  auto shm = StatsShm::attach(name);
+  if(!shm)
+  {
+    std::cerr << "no stats of this version at /dev/shm/" << name << " (stats_shm in the plugin config?)\n";
+    return -1;
+  }
+
+  DxoStats previous{};
+  if(!shm->read(previous))
+  {
+    std::cerr << "no stats published yet\n";
+    return -1;
+  }
+
+  for(uint32_t i{0}; count == 0 || i < count; ++i)
+  {
+    std::this_thread::sleep_for(interval);
+
+    DxoStats stats;
+    if(!shm->read(stats))
+    {
+      continue;
+    }
+
+    // home + clear like top, single samples stay in the scrollback
+    if(count != 1)
+    {
+      std::cout << "\033[H\033[2J";
+    }
+    print(stats, previous);
+    std::cout << std::flush;
+
+    previous = stats;
+  }
+
+  return 0;
+}
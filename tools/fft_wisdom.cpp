@@ -0,0 +1,76 @@
+#include <stdint.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../crossover/fft_wisdom.h"
+
+// Offline planner: creates wisdom for the fft sizes the crossover plans at the given block
+// sizes (inputs, uniform filters and the non-uniform segments of filters up to max taps), so
+// stream open finds all plans in the wisdom file configured by fft_wisdom (default
+// $XDG_CACHE_HOME/dxo/fft.wisdom or ~/.cache/dxo/fft.wisdom of the user running the stream).
+//
+// Batched plans (batched_fft) depend on the number of transforms => planned only for the
+// given inputs, outputs (after summing) and threads of the plugin config.
+//
+// usage: dxo_wisdom <wisdom file> [block sizes] [max taps] [measure|patient|exhaustive]
+//                   [inputs outputs threads]
+//   e.g. dxo_wisdom dxo.wisdom 120,256 65536 patient 3 5 3
+int main(int argc, char* argv[])
+{
+  if(argc < 2)
+  {
+    std::cerr << "usage: " << argv[0] << " <wisdom file> [block sizes] [max taps]"
+              << " [measure|patient|exhaustive] [inputs outputs threads]\n";
+    return -1;
+  }
+
+  std::string path{argv[1]};
+  std::string blockSizes = argc > 2 ? argv[2] : "32,64,128,256,512,1024";
+  uint32_t maxFilterSize = argc > 3 ? std::stoul(argv[3]) : 65536;
+  std::string rigor = argc > 4 ? argv[4] : "patient";
+
+  unsigned planFlags = FFTW_PATIENT;
+  if(rigor == "measure")
+  {
+    planFlags = FFTW_MEASURE;
+  }
+  else if(rigor == "exhaustive")
+  {
+    planFlags = FFTW_EXHAUSTIVE;
+  }
+
+  // keep existing wisdom and only add missing plans
+  FftWisdom wisdom{path};
+
+  std::stringstream sizes{blockSizes};
+  for(std::string size; std::getline(sizes, size, ',');)
+  {
+    FftWisdom::Layout layout{static_cast<uint32_t>(std::stoul(size)), maxFilterSize};
+    if(argc > 7)
+    {
+      layout.numInputs = std::stoul(argv[5]);
+      layout.numOutputs = std::stoul(argv[6]);
+      layout.numThreads = std::stoul(argv[7]);
+    }
+
+    FftWisdom::plan(layout, planFlags);
+  }
+
+  if(!wisdom.hasNewWisdom())
+  {
+    std::cout << "wisdom " << path << " is up to date\n";
+    return 0;
+  }
+
+  if(!wisdom.store())
+  {
+    std::cerr << "writing wisdom " << path << " failed\n";
+    return -1;
+  }
+
+  std::cout << "wisdom written to " << path << "\n";
+  return 0;
+}
@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+
+#include <complex>
+#include <cstdlib>
+#include <vector>
+
+#ifdef BUILD_X86
+#include "../crossover/fft.h"
+#include "../crossover/x86.h"
+
+class X86KernelTest : public testing::TestWithParam<const x86::Kernels*>
+{
+public:
+  static SpectrumVec random(uint32_t size)
+  {
+    SpectrumVec data(size);
+    for(auto& d : data)
+    {
+      d = float((std::rand() % 2000) - 1000) / 100;
+    }
+    return data;
+  }
+
+  static std::complex<float> get(const SpectrumVec& data, uint32_t i)
+  {
+    return {data[i], data[i + data.size() / 2]};
+  }
+
+  static void set(SpectrumVec& data, uint32_t i, std::complex<float> value)
+  {
+    data[i] = value.real();
+    data[i + data.size() / 2] = value.imag();
+  }
+
+  static bool equals(const SpectrumVec& a, const SpectrumVec& b)
+  {
+    for(uint32_t i{0}; i < a.size(); ++i)
+    {
+      if(std::abs(a[i] - b[i]) > 1e-4f * std::max(1.0f, std::abs(a[i])))
+      {
+        return false;
+      }
+    }
+    return a.size() == b.size();
+  }
+
+  // padded spectrum sizes of the fft sizes used by the convolution
+  static constexpr uint32_t kFftSizes[] = {2, 32, 62, 128, 256, 2048, 8192};
+};
+
+TEST_P(X86KernelTest, Test_Multiply)
+{
+  for(auto fftSize : kFftSizes)
+  {
+    auto size = getSpectrumSize(fftSize);
+    auto a = random(size);
+    auto b = random(size);
+    SpectrumVec expected(size);
+    SpectrumVec result(size);
+
+    for(uint32_t i{0}; i < size / 2; ++i)
+    {
+      set(expected, i, get(a, i) * get(b, i));
+    }
+
+    GetParam()->multiply(result.data(), a.data(), b.data(), size / 2);
+    EXPECT_TRUE(equals(result, expected)) << " fft size " << fftSize;
+  }
+}
+
+TEST_P(X86KernelTest, Test_MultiplyAdd)
+{
+  for(auto fftSize : kFftSizes)
+  {
+    auto size = getSpectrumSize(fftSize);
+    auto a = random(size);
+    auto b = random(size);
+    auto expected = random(size);
+    auto result = expected;
+
+    for(uint32_t i{0}; i < size / 2; ++i)
+    {
+      set(expected, i, get(expected, i) + get(a, i) * get(b, i));
+    }
+
+    GetParam()->multiplyAdd(result.data(), a.data(), b.data(), size / 2);
+    EXPECT_TRUE(equals(result, expected)) << " fft size " << fftSize;
+  }
+}
+
+TEST_P(X86KernelTest, Test_MultiplyAccumulate)
+{
+  for(auto fftSize : kFftSizes)
+  {
+    auto size = getSpectrumSize(fftSize);
+    auto a = random(size);
+    auto b = random(size);
+    auto c = random(size);
+    SpectrumVec expected(size);
+    SpectrumVec result(size);
+
+    for(uint32_t i{0}; i < size / 2; ++i)
+    {
+      set(expected, i, get(a, i) * get(b, i) + get(c, i));
+    }
+
+    GetParam()->multiplyAccumulate(result.data(), a.data(), b.data(), c.data(), size / 2);
+    EXPECT_TRUE(equals(result, expected)) << " fft size " << fftSize;
+  }
+}
+
+TEST_P(X86KernelTest, Test_Add)
+{
+  for(auto fftSize : kFftSizes)
+  {
+    auto size = getSpectrumSize(fftSize);
+    auto a = random(size);
+    auto b = random(size);
+    SpectrumVec expected(size);
+
+    for(uint32_t i{0}; i < size; ++i)
+    {
+      expected[i] = a[i] + b[i];
+    }
+
+    // in place as used by sumBlocks
+    GetParam()->add(a.data(), a.data(), b.data(), size);
+    EXPECT_TRUE(equals(a, expected)) << " fft size " << fftSize;
+  }
+}
+
+TEST_P(X86KernelTest, Test_Fir)
+{
+  constexpr uint32_t kNumTaps = 37;
+  auto h = random(kNumTaps);
+
+  // odd frame counts cover the vector remainders and the scalar tail
+  for(uint32_t frames : {1, 3, 4, 13, 16, 35, 64, 77})
+  {
+    auto x = random(kNumTaps - 1 + frames);
+    auto expected = random(frames);
+    auto result = expected;
+
+    for(uint32_t i{0}; i < frames; ++i)
+    {
+      for(uint32_t m{0}; m < kNumTaps; ++m)
+      {
+        expected[i] += h[m] * x[kNumTaps - 1 + i - m];
+      }
+    }
+
+    GetParam()->fir(result.data(), h.data(), x.data() + kNumTaps - 1, kNumTaps, frames);
+    EXPECT_TRUE(equals(result, expected)) << " frames " << frames;
+  }
+}
+
+static std::vector<const x86::Kernels*> getAvx2Kernels()
+{
+  return x86::hasAvx2() ? std::vector<const x86::Kernels*>{&x86::kAvx2Kernels}
+                        : std::vector<const x86::Kernels*>{};
+}
+
+INSTANTIATE_TEST_SUITE_P(Sse2, X86KernelTest, testing::Values(&x86::kSse2Kernels));
+INSTANTIATE_TEST_SUITE_P(Avx2, X86KernelTest, testing::ValuesIn(getAvx2Kernels()));
+GTEST_ALLOW_UNINSTANTIATED_PARAMETERIZED_TEST(X86KernelTest);
+
+#endif